@@ -0,0 +1,116 @@
+#include "GlitchEngine.h"
+
+void GlitchEngine::prepare (double newSampleRate)
+{
+    sampleRate = newSampleRate;
+    boundaryLength = juce::jmax (1, (int) (sampleRate / 100));
+
+    // The longest slice (eight boundaries) repeated the most times, plus the slice itself
+    const int size = juce::nextPowerOfTwo (boundaryLength * 8 * (maxRepeats + 1) + 1);
+    capture.assign ((size_t) size, 0.0f);
+    captureMask = size - 1;
+    reset();
+}
+
+void GlitchEngine::reset() noexcept
+{
+    writePosition = 0;
+    captured = 0;
+    mode = Mode::Through;
+    eventLength = 0;
+    elapsed = 0;
+    seed = 1;
+}
+
+float GlitchEngine::nextRandom() noexcept
+{
+    seed = seed * 1664525u + 1013904223u;
+    return (float) (seed >> 8) * (1.0f / 16777216.0f);
+}
+
+void GlitchEngine::startSlice (float glitchChance, float amount) noexcept
+{
+    elapsed = 0;
+    mode = Mode::Through;
+    eventLength = boundaryLength;
+
+    if (nextRandom() >= glitchChance * amount)
+        return;
+
+    // A slice of 10 to 80 ms, out of what has been recorded so far
+    const int length = boundaryLength << (int) (nextRandom() * 4.0f);
+    if (length > captured)
+        return;
+
+    const float choice = nextRandom();
+    mode = choice < 0.5f ? Mode::Repeat : (choice < 0.8f ? Mode::Reverse : Mode::PitchDrop);
+    sliceLength = length;
+    sliceStart = (writePosition - length) & captureMask;
+    slicePosition = 0;
+
+    const int repeats = juce::jlimit (1, maxRepeats, 1 + (int) (nextRandom() * amount * maxRepeats));
+    eventLength = length * (mode == Mode::Repeat ? juce::jmax (2, repeats) : repeats);
+
+    // The tape comes to a stop at the end of the glitch
+    readPosition = 0.0;
+    rate = 1.0f;
+    rateStep = 1.0f / (float) eventLength;
+}
+
+float GlitchEngine::process (float input, float glitchChance, float amount) noexcept
+{
+    if (capture.empty())
+        return input;
+
+    capture[(size_t) writePosition] = input;
+    writePosition = (writePosition + 1) & captureMask;
+    captured = juce::jmin (captured + 1, captureMask + 1);
+
+    if (elapsed >= eventLength)
+        startSlice (glitchChance, amount);
+
+    if (mode == Mode::Through)
+    {
+        ++elapsed;
+        return input;
+    }
+
+    float wet;
+    switch (mode)
+    {
+        case Mode::Reverse:
+            wet = capture[(size_t) ((sliceStart + sliceLength - 1 - slicePosition) & captureMask)];
+            break;
+
+        case Mode::PitchDrop:
+        {
+            const int index = (int) readPosition;
+            const float fraction = (float) (readPosition - index);
+            const float s0 = capture[(size_t) ((sliceStart + index) & captureMask)];
+            const float s1 = capture[(size_t) ((sliceStart + (index + 1) % sliceLength) & captureMask)];
+            wet = s0 + (s1 - s0) * fraction;
+
+            readPosition += rate;
+            if (readPosition >= sliceLength)
+                readPosition -= sliceLength;
+            rate = juce::jmax (0.0f, rate - rateStep);
+            break;
+        }
+
+        case Mode::Repeat:
+        case Mode::Through:
+        default:
+            wet = capture[(size_t) ((sliceStart + slicePosition) & captureMask)];
+            break;
+    }
+
+    if (++slicePosition >= sliceLength)
+        slicePosition = 0;
+
+    // Short fades at both ends so the cuts do not click
+    const int edge = juce::jmin (elapsed, eventLength - 1 - elapsed);
+    const float fade = juce::jmin (1.0f, (float) edge / (float) fadeLength);
+    ++elapsed;
+
+    return input + (wet - input) * fade;
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Buffer-repeat stutter engine for the Glitcher weird type. The voice's output is
+// recorded into a ring buffer, and every 10 ms a cheap deterministic generator decides
+// whether the next stretch plays through or replays the last slice: repeated, reversed,
+// or dropping in pitch like a stopping tape. Nothing is decided between boundaries.
+//
+// Memory is only allocated in prepare(), and reset() is constant time. Slices are only
+// taken from what was recorded since the last reset, so glitched notes stay cacheable.
+class GlitchEngine
+{
+public:
+    void prepare (double sampleRate);
+    void reset() noexcept;
+
+    // Records input and returns it, or the glitch playing over it. A glitch starts at a
+    // boundary with probability glitchChance * amount; amount also sets how often it repeats.
+    float process (float input, float glitchChance, float amount) noexcept;
+
+private:
+    enum class Mode
+    {
+        Through,
+        Repeat,
+        Reverse,
+        PitchDrop
+    };
+
+    static constexpr int maxRepeats = 4;
+    static constexpr int fadeLength = 32;   // samples faded at each end of a glitch
+
+    void startSlice (float glitchChance, float amount) noexcept;
+    float nextRandom() noexcept;
+
+    double sampleRate = 44100.0;
+    int boundaryLength = 441;               // 10 ms
+    std::vector<float> capture;
+    int captureMask = 0;
+    int writePosition = 0;
+    int captured = 0;                       // samples recorded since the last reset
+
+    Mode mode = Mode::Through;
+    int sliceStart = 0;                     // the replayed slice, in the capture buffer
+    int sliceLength = 0;
+    int slicePosition = 0;
+    double readPosition = 0.0;              // within the slice, for PitchDrop
+    float rate = 1.0f;
+    float rateStep = 0.0f;
+    int eventLength = 0;                    // samples from this boundary to the next
+    int elapsed = 0;
+    juce::uint32 seed = 1;
+};
\ No newline at end of file
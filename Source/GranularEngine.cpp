@@ -0,0 +1,127 @@
+#include "GranularEngine.h"
+
+static constexpr double maxGrainSeconds = 0.25;
+
+const std::array<float, GranularEngine::windowSize + 1>& GranularEngine::getWindow()
+{
+    // Hann window, with a guard point so lookups can interpolate up to the last sample
+    static const auto window = []
+    {
+        std::array<float, windowSize + 1> w {};
+        for (int i = 0; i <= windowSize; ++i)
+            w[(size_t) i] = 0.5f - 0.5f * std::cos (juce::MathConstants<float>::twoPi * (float) i / (float) windowSize);
+        return w;
+    }();
+
+    return window;
+}
+
+void GranularEngine::prepare (double newSampleRate)
+{
+    sampleRate = newSampleRate;
+    getWindow();
+
+    // Room for the longest grain slowed down an octave, plus the furthest scatter
+    const int size = juce::nextPowerOfTwo ((int) std::ceil ((maxScatterSeconds + 2.0 * maxGrainSeconds) * sampleRate) + 4);
+    capture.assign ((size_t) size, 0.0f);
+    captureMask = size - 1;
+    reset();
+}
+
+void GranularEngine::reset() noexcept
+{
+    writePosition = 0;
+    captured = 0;
+    numActive = 0;
+    samplesUntilNextGrain = 0;
+    grainGain = 1.0f;
+    seed = 1;
+}
+
+float GranularEngine::nextRandom() noexcept
+{
+    seed = seed * 1664525u + 1013904223u;
+    return (float) (seed >> 8) * (1.0f / 16777216.0f);
+}
+
+void GranularEngine::startGrain (int length, float amount, int grainLimit) noexcept
+{
+    if (numActive >= juce::jmin (grainLimit, maxGrains))
+        return;
+
+    // Mostly at pitch; octave jumps and detune come in as the knob goes up
+    const float pitchChoice = nextRandom();
+    float rate = pitchChoice < amount * 0.2f ? 0.5f : (pitchChoice < amount * 0.4f ? 2.0f : 1.0f);
+    rate *= 1.0f + (nextRandom() - 0.5f) * 0.02f * amount;
+
+    // The read head has to stay behind the write head for the whole grain, and
+    // only read samples recorded since the last reset
+    const double minDelay = 2.0 + juce::jmax (0.0f, rate - 1.0f) * (float) length;
+    const double maxDelay = juce::jmin (captured, (int) capture.size() - length) - 2.0;
+    if (minDelay > maxDelay)
+        return;
+
+    const double scatter = nextRandom() * amount * maxScatterSeconds * sampleRate;
+    const double delay = juce::jmin (minDelay + scatter, maxDelay);
+
+    auto& grain = grains[(size_t) numActive++];
+    grain.position = writePosition - delay;
+    if (grain.position < 0.0)
+        grain.position += (double) capture.size();
+    grain.rate = rate;
+    grain.windowPosition = 0.0f;
+    grain.windowIncrement = (float) windowSize / (float) length;
+}
+
+float GranularEngine::process (float input, float grainSeconds, float amount, int grainLimit) noexcept
+{
+    if (capture.empty())
+        return input;
+
+    capture[(size_t) writePosition] = input;
+    writePosition = (writePosition + 1) & captureMask;
+    captured = juce::jmin (captured + 1, (int) capture.size());
+
+    // From one grain at a time up to about 128 overlapping as the knob goes up
+    const int length = juce::jlimit (16, (int) (maxGrainSeconds * sampleRate), (int) (grainSeconds * sampleRate));
+    if (--samplesUntilNextGrain <= 0)
+    {
+        const float overlap = 1.0f + amount * 127.0f;
+        samplesUntilNextGrain = juce::jmax (1, (int) ((float) length / overlap * (0.5f + nextRandom())));
+        grainGain = 1.0f / std::sqrt (overlap);
+        startGrain (length, amount, grainLimit);
+    }
+
+    const auto& window = getWindow();
+    const double size = (double) capture.size();
+    float wet = 0.0f;
+
+    for (int i = 0; i < numActive;)
+    {
+        auto& grain = grains[(size_t) i];
+
+        const int index = (int) grain.position;
+        const float fraction = (float) (grain.position - index);
+        const float s0 = capture[(size_t) index];
+        const float s1 = capture[(size_t) ((index + 1) & captureMask)];
+
+        const int windowIndex = (int) grain.windowPosition;
+        const float windowFraction = grain.windowPosition - (float) windowIndex;
+        const float w = window[(size_t) windowIndex] + (window[(size_t) windowIndex + 1] - window[(size_t) windowIndex]) * windowFraction;
+
+        wet += (s0 + (s1 - s0) * fraction) * w;
+
+        grain.position += grain.rate;
+        if (grain.position >= size)
+            grain.position -= size;
+
+        // Finished grains are replaced by the last active one
+        grain.windowPosition += grain.windowIncrement;
+        if (grain.windowPosition >= (float) windowSize)
+            grain = grains[(size_t) --numActive];
+        else
+            ++i;
+    }
+
+    return input * (1.0f - amount) + wet * grainGain * amount * 2.0f;
+}
\ No newline at end of file
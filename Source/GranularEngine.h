@@ -0,0 +1,52 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Micro-grain engine for the Granular weird type. The voice's output is recorded into
+// a ring buffer, and a pool of grains plays it back, each from its own position and at
+// its own pitch under a window read from a table. Memory is only allocated in prepare(),
+// and reset() is constant time, so a note-on never touches the buffer.
+//
+// Grains only read what was recorded since the last reset, so the output depends on
+// nothing but the note's own history and the note cache can still freeze it.
+class GranularEngine
+{
+public:
+    static constexpr int maxGrains = 256;
+
+    void prepare (double sampleRate);
+    void reset() noexcept;
+
+    // Records input and returns it mixed with the grains. amount (0-1) sets the grain
+    // density, scatter and pitch spread; at most grainLimit grains play at once.
+    float process (float input, float grainSeconds, float amount, int grainLimit) noexcept;
+
+private:
+    struct Grain
+    {
+        double position = 0.0;        // read position in the capture buffer
+        float rate = 1.0f;            // playback speed, 2 is an octave up
+        float windowPosition = 0.0f;
+        float windowIncrement = 0.0f;
+    };
+
+    static constexpr int windowSize = 1024;
+    static constexpr double maxScatterSeconds = 0.5;
+
+    static const std::array<float, windowSize + 1>& getWindow();
+
+    void startGrain (int length, float amount, int grainLimit) noexcept;
+    float nextRandom() noexcept;
+
+    double sampleRate = 44100.0;
+    std::vector<float> capture;
+    int captureMask = 0;
+    int writePosition = 0;
+    int captured = 0;                 // samples recorded since the last reset
+
+    std::array<Grain, maxGrains> grains;
+    int numActive = 0;                // grains[0, numActive) are playing
+    int samplesUntilNextGrain = 0;
+    float grainGain = 1.0f;
+    juce::uint32 seed = 1;
+};
\ No newline at end of file
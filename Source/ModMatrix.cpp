@@ -0,0 +1,314 @@
+#include "ModMatrix.h"
+
+namespace
+{
+    template <typename Enum>
+    bool parseName (const juce::var& value, int numValues, const char* (*getName) (Enum), Enum& result)
+    {
+        for (int i = 0; i < numValues; ++i)
+        {
+            if (value.toString().equalsIgnoreCase (getName (static_cast<Enum> (i))))
+            {
+                result = static_cast<Enum> (i);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    float getLfoValue (ModMatrix::LfoShape shape, double phase) noexcept
+    {
+        const auto p = (float) phase;
+        switch (shape)
+        {
+            case ModMatrix::LfoShape::Triangle: return 1.0f - 4.0f * std::abs (p - 0.5f);
+            case ModMatrix::LfoShape::Saw:      return 2.0f * p - 1.0f;
+            case ModMatrix::LfoShape::Square:   return p < 0.5f ? 1.0f : -1.0f;
+            case ModMatrix::LfoShape::Sine:
+            default:                            return std::sin (p * juce::MathConstants<float>::twoPi);
+        }
+    }
+
+    bool isAudioRateDestination (int destination) noexcept
+    {
+        // The only values the voice reads per sample
+        return destination == (int) ModMatrix::Destination::Amount
+            || destination == (int) ModMatrix::Destination::Cutoff
+            || destination == (int) ModMatrix::Destination::Resonance;
+    }
+
+    constexpr float octavesPerUnit = 4.0f;
+}
+
+const char* ModMatrix::getSourceName (Source source)
+{
+    switch (source)
+    {
+        case Source::Lfo1:          return "lfo1";
+        case Source::Lfo2:          return "lfo2";
+        case Source::AmpEnvelope:   return "ampEnvelope";
+        case Source::ModEnvelope:   return "modEnvelope";
+        case Source::Velocity:      return "velocity";
+        case Source::NoteNumber:    return "note";
+        default:                    return "unknown";
+    }
+}
+
+const char* ModMatrix::getDestinationName (Destination destination)
+{
+    switch (destination)
+    {
+        case Destination::Weirdness:    return "weirdness";
+        case Destination::Amount:       return "amount";
+        case Destination::Cutoff:       return "cutoff";
+        case Destination::Resonance:    return "resonance";
+        case Destination::WobbleRate:   return "wobbleRate";
+        case Destination::GlitchChance: return "glitchChance";
+        case Destination::HarmonicMix:  return "harmonicMix";
+        case Destination::RingModFreq:  return "ringModFreq";
+        case Destination::FilterFreq:   return "filterFreq";
+        case Destination::GrainSize:    return "grainSize";
+        default:                        return "unknown";
+    }
+}
+
+const char* ModMatrix::getLfoShapeName (LfoShape shape)
+{
+    switch (shape)
+    {
+        case LfoShape::Sine:        return "sine";
+        case LfoShape::Triangle:    return "triangle";
+        case LfoShape::Saw:         return "saw";
+        case LfoShape::Square:      return "square";
+        default:                    return "unknown";
+    }
+}
+
+//==============================================================================
+juce::Result ModMatrix::Settings::parseJson (const juce::String& text)
+{
+    juce::var json;
+    auto result = juce::JSON::parse (text, json);
+    if (result.failed())
+        return result;
+
+    if (! json.isObject())
+        return juce::Result::fail ("expected an object");
+
+    // Work on a copy, so settings with errors leave these untouched
+    auto parsed = *this;
+
+    if (json.hasProperty ("lfos"))
+    {
+        const auto& lfoList = json["lfos"];
+        if (! lfoList.isArray() || lfoList.size() > numLfos)
+            return juce::Result::fail ("\"lfos\" must be a list of up to " + juce::String (numLfos));
+
+        for (int i = 0; i < lfoList.size(); ++i)
+        {
+            const auto& lfo = lfoList[i];
+            auto& target = parsed.lfos[(size_t) i];
+            if (lfo.hasProperty ("rate"))
+                target.rate = juce::jlimit (0.0f, 2000.0f, (float) lfo["rate"]);
+
+            if (lfo.hasProperty ("shape") && ! parseName (lfo["shape"], (int) LfoShape::NUM_SHAPES, &getLfoShapeName, target.shape))
+                return juce::Result::fail ("unknown LFO shape " + lfo["shape"].toString().quoted());
+        }
+    }
+
+    if (json.hasProperty ("modEnvelope"))
+    {
+        const auto& envelope = json["modEnvelope"];
+        if (envelope.hasProperty ("attack"))
+            parsed.modAttack = juce::jlimit (0.0005f, 30.0f, (float) envelope["attack"]);
+        if (envelope.hasProperty ("decay"))
+            parsed.modDecay = juce::jlimit (0.0005f, 30.0f, (float) envelope["decay"]);
+    }
+
+    if (json.hasProperty ("routes"))
+    {
+        const auto& routeList = json["routes"];
+        if (! routeList.isArray() || routeList.size() > maxRoutes)
+            return juce::Result::fail ("\"routes\" must be a list of up to " + juce::String (maxRoutes));
+
+        parsed.routes.clear();
+        for (int i = 0; i < routeList.size(); ++i)
+        {
+            const auto& entry = routeList[i];
+            Route route;
+            if (! parseName (entry["source"], numSources, &getSourceName, route.source))
+                return juce::Result::fail ("unknown source " + entry["source"].toString().quoted());
+
+            if (! parseName (entry["destination"], numDestinations, &getDestinationName, route.destination))
+                return juce::Result::fail ("unknown destination " + entry["destination"].toString().quoted());
+
+            route.depth = juce::jlimit (-1.0f, 1.0f, (float) entry["depth"]);
+            parsed.routes.push_back (route);
+        }
+    }
+
+    *this = parsed;
+    return juce::Result::ok();
+}
+
+juce::String ModMatrix::Settings::toJson() const
+{
+    juce::Array<juce::var> lfoList;
+    for (const auto& lfo : lfos)
+    {
+        auto* object = new juce::DynamicObject();
+        object->setProperty ("rate", lfo.rate);
+        object->setProperty ("shape", getLfoShapeName (lfo.shape));
+        lfoList.add (juce::var (object));
+    }
+
+    auto* envelope = new juce::DynamicObject();
+    envelope->setProperty ("attack", modAttack);
+    envelope->setProperty ("decay", modDecay);
+
+    juce::Array<juce::var> routeList;
+    for (const auto& route : routes)
+    {
+        auto* object = new juce::DynamicObject();
+        object->setProperty ("source", getSourceName (route.source));
+        object->setProperty ("destination", getDestinationName (route.destination));
+        object->setProperty ("depth", route.depth);
+        routeList.add (juce::var (object));
+    }
+
+    auto* root = new juce::DynamicObject();
+    root->setProperty ("lfos", lfoList);
+    root->setProperty ("modEnvelope", juce::var (envelope));
+    root->setProperty ("routes", routeList);
+    return juce::JSON::toString (juce::var (root), true);
+}
+
+//==============================================================================
+std::shared_ptr<const ModMatrix::Compiled> ModMatrix::compile (const Settings& settings, double sampleRate, int segmentSize)
+{
+    auto compiled = std::make_shared<Compiled>();
+
+    for (int i = 0; i < numLfos; ++i)
+    {
+        compiled->lfoIncrements[(size_t) i] = (float) (settings.lfos[(size_t) i].rate / sampleRate);
+        compiled->lfoShapes[(size_t) i] = settings.lfos[(size_t) i].shape;
+    }
+
+    compiled->modAttackStep = (float) (1.0 / (settings.modAttack * sampleRate));
+    compiled->modDecayStep = (float) (1.0 / (settings.modDecay * sampleRate));
+
+    // Repeated pairs are summed into one route, and routes that cancel out are dropped
+    std::array<std::array<float, numDestinations>, numSources> depths {};
+    for (const auto& route : settings.routes)
+        depths[(size_t) route.source][(size_t) route.destination] += route.depth;
+
+    for (int source = 0; source < numSources; ++source)
+    {
+        for (int destination = 0; destination < numDestinations; ++destination)
+        {
+            const float depth = depths[(size_t) source][(size_t) destination];
+            if (depth == 0.0f)
+                continue;
+
+            // An LFO that completes a cycle in fewer than 16 segments would step audibly at
+            // segment rate; on the per-sample inputs it is followed per sample instead
+            const bool fastLfo = source < numLfos && compiled->lfoIncrements[(size_t) source] * segmentSize > 1.0f / 16.0f;
+            auto& list = fastLfo && isAudioRateDestination (destination) ? compiled->audioRoutes : compiled->controlRoutes;
+            list.push_back ({ source, destination, depth });
+        }
+    }
+
+    for (int lfo = 0; lfo < numLfos; ++lfo)
+        if (std::any_of (compiled->audioRoutes.begin(), compiled->audioRoutes.end(), [lfo] (const auto& r) { return r.source == lfo; }))
+            compiled->audioLfos.push_back (lfo);
+
+    return compiled;
+}
+
+//==============================================================================
+void ModMatrix::State::noteOn() noexcept
+{
+    lfoPhases.fill (0.0);
+    modEnvelope = 0.0f;
+    modAttacking = true;
+}
+
+void ModMatrix::State::beginSegment (const Compiled& compiled, float ampEnvelope, float velocity, int note, int numSamples) noexcept
+{
+    for (size_t i = 0; i < (size_t) numLfos; ++i)
+    {
+        sources[i] = getLfoValue (compiled.lfoShapes[i], lfoPhases[i]);
+        audioPhases[i] = lfoPhases[i];
+        lfoPhases[i] += (double) compiled.lfoIncrements[i] * numSamples;
+        lfoPhases[i] -= std::floor (lfoPhases[i]);
+    }
+
+    sources[(size_t) Source::AmpEnvelope] = ampEnvelope;
+    sources[(size_t) Source::ModEnvelope] = modEnvelope;
+    sources[(size_t) Source::Velocity] = velocity;
+    sources[(size_t) Source::NoteNumber] = (float) (note - 60) / 64.0f;
+
+    if (modAttacking)
+    {
+        modEnvelope += compiled.modAttackStep * numSamples;
+        if (modEnvelope >= 1.0f)
+        {
+            modEnvelope = 1.0f;
+            modAttacking = false;
+        }
+    }
+    else
+    {
+        modEnvelope = juce::jmax (0.0f, modEnvelope - compiled.modDecayStep * numSamples);
+    }
+
+    offsets.fill (0.0f);
+    for (const auto& route : compiled.controlRoutes)
+        offsets[(size_t) route.destination] += sources[(size_t) route.source] * route.depth;
+}
+
+void ModMatrix::State::applyAudioRate (const Compiled& compiled, float& amount, float& cutoff, float& resonance) noexcept
+{
+    std::array<float, numLfos> lfos {};
+    for (int lfo : compiled.audioLfos)
+    {
+        lfos[(size_t) lfo] = getLfoValue (compiled.lfoShapes[(size_t) lfo], audioPhases[(size_t) lfo]);
+        audioPhases[(size_t) lfo] += compiled.lfoIncrements[(size_t) lfo];
+        if (audioPhases[(size_t) lfo] >= 1.0)
+            audioPhases[(size_t) lfo] -= 1.0;
+    }
+
+    auto audioOffsets = offsets;
+    for (const auto& route : compiled.audioRoutes)
+        audioOffsets[(size_t) route.destination] += lfos[(size_t) route.source] * route.depth;
+
+    amount = modulate (Destination::Amount, amount, audioOffsets[(size_t) Destination::Amount]);
+    cutoff = modulate (Destination::Cutoff, cutoff, audioOffsets[(size_t) Destination::Cutoff]);
+    resonance = modulate (Destination::Resonance, resonance, audioOffsets[(size_t) Destination::Resonance]);
+}
+
+//==============================================================================
+float ModMatrix::modulate (Destination destination, float value, float offset) noexcept
+{
+    // Ranges match what a personality map may set
+    auto octaves = [value, offset] (float minimum, float maximum)
+    {
+        return juce::jlimit (minimum, maximum, value * std::exp2 (offset * octavesPerUnit));
+    };
+
+    switch (destination)
+    {
+        case Destination::Weirdness:
+        case Destination::Amount:
+        case Destination::GlitchChance: return juce::jlimit (0.0f, 1.0f, value + offset);
+        case Destination::Resonance:    return juce::jlimit (0.0f, 0.99f, value + offset);
+        case Destination::Cutoff:
+        case Destination::FilterFreq:   return octaves (20.0f, 20000.0f);
+        case Destination::RingModFreq:  return octaves (0.0f, 20000.0f);
+        case Destination::WobbleRate:   return octaves (0.0f, 100.0f);
+        case Destination::HarmonicMix:  return octaves (0.0f, 32.0f);
+        case Destination::GrainSize:    return octaves (0.0005f, 1.0f);
+        default:                        return value;
+    }
+}
\ No newline at end of file
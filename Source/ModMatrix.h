@@ -0,0 +1,147 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Modulation matrix: two LFOs, the amp and modulation envelopes, velocity and note
+// number, routed with a depth each to the knob, the per-knob amount, cutoff and
+// resonance, and the per-note type amounts.
+//
+// Settings are what the user edits (and the session stores, as JSON). Whenever they
+// or the sample rate change they are compiled off the audio thread into flat lists of
+// (source, destination, depth) triples, split by rate: most routes are summed once per
+// segment, and only fast LFOs on the per-sample inputs of the voice are summed per sample.
+//
+//   { "lfos": [ { "rate": 0.5, "shape": "triangle" }, { "rate": 220, "shape": "sine" } ],
+//     "modEnvelope": { "attack": 0.01, "decay": 0.8 },
+//     "routes": [ { "source": "lfo1", "destination": "weirdness", "depth": 0.2 },
+//                 { "source": "modEnvelope", "destination": "cutoff", "depth": 0.5 } ] }
+struct ModMatrix
+{
+    enum class Source
+    {
+        Lfo1,
+        Lfo2,
+        AmpEnvelope,
+        ModEnvelope,
+        Velocity,
+        NoteNumber,     // about -1 at note 0, 0 at middle C, about 1 at the top
+        NUM_SOURCES
+    };
+
+    enum class Destination
+    {
+        Weirdness,      // moves the knob position the per-knob values are read at
+        Amount,
+        Cutoff,
+        Resonance,
+        WobbleRate,
+        GlitchChance,
+        HarmonicMix,
+        RingModFreq,
+        FilterFreq,
+        GrainSize,
+        NUM_DESTINATIONS
+    };
+
+    enum class LfoShape
+    {
+        Sine,
+        Triangle,
+        Saw,
+        Square,
+        NUM_SHAPES
+    };
+
+    static constexpr int numLfos = 2;
+    static constexpr int numSources = (int) Source::NUM_SOURCES;
+    static constexpr int numDestinations = (int) Destination::NUM_DESTINATIONS;
+
+    static const char* getSourceName (Source source);
+    static const char* getDestinationName (Destination destination);
+    static const char* getLfoShapeName (LfoShape shape);
+
+    //==============================================================================
+    struct Settings
+    {
+        struct Lfo
+        {
+            float rate = 1.0f;        // Hz
+            LfoShape shape = LfoShape::Sine;
+        };
+
+        struct Route
+        {
+            Source source = Source::Lfo1;
+            Destination destination = Destination::Weirdness;
+            float depth = 0.0f;       // -1 to 1 of the destination's range
+        };
+
+        std::array<Lfo, numLfos> lfos;
+        float modAttack = 0.01f;      // seconds
+        float modDecay = 0.5f;        // seconds, down to 0
+        std::vector<Route> routes;
+
+        bool isEmpty() const noexcept   { return routes.empty(); }
+
+        // Reads the settings over these ones; on failure they are left as they were
+        juce::Result parseJson (const juce::String& json);
+        juce::String toJson() const;
+    };
+
+    static constexpr int maxRoutes = 64;
+
+    //==============================================================================
+    // Settings resolved for one sample rate and segment size; immutable once built
+    struct Compiled
+    {
+        struct Route
+        {
+            int source;
+            int destination;
+            float depth;
+        };
+
+        std::vector<Route> controlRoutes;   // summed once per segment
+        std::vector<Route> audioRoutes;     // LFOs -> Amount, Cutoff or Resonance, summed per sample
+        std::vector<int> audioLfos;         // the LFOs the audio-rate routes read
+        std::array<float, numLfos> lfoIncrements {};
+        std::array<LfoShape, numLfos> lfoShapes {};
+        float modAttackStep = 1.0f;
+        float modDecayStep = 1.0f;
+
+        bool isActive() const noexcept  { return ! controlRoutes.empty() || ! audioRoutes.empty(); }
+        bool hasAudioRoutes() const noexcept  { return ! audioRoutes.empty(); }
+    };
+
+    static std::shared_ptr<const Compiled> compile (const Settings& settings, double sampleRate, int segmentSize);
+
+    //==============================================================================
+    // Per-voice modulation state, owned by the audio thread
+    struct State
+    {
+        // Retriggers the LFOs and the modulation envelope
+        void noteOn() noexcept;
+
+        // Evaluates the sources at the start of a segment, sums the control-rate routes
+        // into offsets, and moves the sources on to the end of the segment
+        void beginSegment (const Compiled& compiled, float ampEnvelope, float velocity, int note, int numSamples) noexcept;
+
+        // Modulates the next sample's amount, cutoff and resonance (given unmodulated) by the
+        // segment's offsets plus the audio-rate routes
+        void applyAudioRate (const Compiled& compiled, float& amount, float& cutoff, float& resonance) noexcept;
+
+        float getOffset (Destination destination) const noexcept  { return offsets[(size_t) destination]; }
+
+    private:
+        std::array<float, numSources> sources {};
+        std::array<float, numDestinations> offsets {};
+        std::array<double, numLfos> lfoPhases {};
+        std::array<double, numLfos> audioPhases {};   // the LFOs within the current segment
+        float modEnvelope = 0.0f;
+        bool modAttacking = true;
+    };
+
+    // Applies an offset to a destination's value, within its range. Amount-like values move
+    // linearly; frequencies, rates and sizes move by octaves, so depth 1 means 4 octaves.
+    static float modulate (Destination destination, float value, float offset) noexcept;
+};
\ No newline at end of file
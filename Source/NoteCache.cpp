@@ -0,0 +1,245 @@
+#include "NoteCache.h"
+
+NoteCache::NoteCache (const FidgetAudioProcessor& processor)
+    : juce::Thread ("Fidget note cache"),
+      owner (processor)
+{
+}
+
+NoteCache::~NoteCache()
+{
+    release();
+}
+
+void NoteCache::prepare (double newSampleRate)
+{
+    const juce::ScopedLock sl (stateLock);
+    release();
+    sampleRate = newSampleRate;
+    prepared = true;
+
+    if (enabled)
+        startRendering();
+}
+
+void NoteCache::release()
+{
+    const juce::ScopedLock sl (stateLock);
+    prepared = false;
+    slots.store (nullptr);
+    stopThread (2000);
+
+    if (slotStorage != nullptr)
+        for (auto& slot : *slotStorage)
+            slot.store (nullptr);
+
+    pinned.store (nullptr);
+    entries.clear();
+    retired.clear();
+    bytesUsed = 0;
+    discardRequests();
+}
+
+void NoteCache::setEnabled (bool shouldBeEnabled)
+{
+    const juce::ScopedLock sl (stateLock);
+    if (enabled == shouldBeEnabled)
+        return;
+
+    enabled = shouldBeEnabled;
+    if (! prepared)
+        return;
+
+    if (enabled)
+        startRendering();
+    else
+        stopRendering();
+}
+
+void NoteCache::startRendering()
+{
+    if (slotStorage == nullptr)
+    {
+        slotStorage = std::make_unique<Slots>();
+        for (auto& slot : *slotStorage)
+            slot.store (nullptr);
+        renderVoice = std::make_unique<FidgetAudioProcessor::Voice>();
+    }
+
+    renderVoice->prepare (sampleRate);
+    slots.store (slotStorage.get());
+    startThread();
+}
+
+void NoteCache::stopRendering()
+{
+    // Unpublished first, so the audio thread stops looking entries up and queueing renders.
+    // It may still be playing out a pinned entry, so that one is kept.
+    slots.store (nullptr);
+    stopThread (2000);
+    while (! entries.empty())
+        evict (entries.begin());
+    freeRetired();
+    discardRequests();
+}
+
+void NoteCache::discardRequests()
+{
+    // Only ever done from the reading side: an acquire() that loaded the slots just before they
+    // were unpublished may still be queueing a request, so the queue is never reset under it
+    int start1, size1, start2, size2;
+    requests.prepareToRead (requests.getNumReady(), start1, size1, start2, size2);
+    requests.finishedRead (size1 + size2);
+}
+
+const NoteCache::Entry* NoteCache::acquire (int midiNote, int knobPosition, juce::uint32 mappingGeneration, juce::uint32 tuningGeneration) noexcept
+{
+    auto* table = slots.load();
+    if (table == nullptr)
+        return nullptr;
+
+    const int key = midiNote * 128 + knobPosition;
+    auto& slot = (*table)[(size_t) key];
+
+    auto* entry = slot.load();
+    if (entry != nullptr)
+    {
+        // Pin first, then check it has not been evicted in the meantime; until then it may
+        // already be freed. Entries from another mapping or tuning are left for the
+        // background thread to replace.
+        pinned.store (entry);
+        if (slot.load() == entry && entry->mappingGeneration == mappingGeneration && entry->tuningGeneration == tuningGeneration)
+        {
+            entry->lastUsed.store (++useClock, std::memory_order_relaxed);
+            return entry;
+        }
+        pinned.store (nullptr);
+    }
+
+    int start1, size1, start2, size2;
+    requests.prepareToWrite (1, start1, size1, start2, size2);
+    if (size1 + size2 > 0)
+    {
+        requestKeys[(size_t) (size1 > 0 ? start1 : start2)] = key;
+        requests.finishedWrite (1);
+    }
+
+    return nullptr;
+}
+
+void NoteCache::run()
+{
+    while (! threadShouldExit())
+    {
+        wait (20);
+
+        // Program switches, retuning and restored sessions make everything rendered so far stale
+        const auto mapping = owner.getNoteWeirdnessSnapshot();
+        const auto pitches = owner.getPitchTableSnapshot();
+        evictStale (mapping.generation, pitches.generation);
+
+        int start1, size1, start2, size2;
+        requests.prepareToRead (requests.getNumReady(), start1, size1, start2, size2);
+
+        std::vector<int> keys;
+        for (int i = 0; i < size1; ++i) keys.push_back (requestKeys[(size_t) (start1 + i)]);
+        for (int i = 0; i < size2; ++i) keys.push_back (requestKeys[(size_t) (start2 + i)]);
+        requests.finishedRead (size1 + size2);
+
+        for (auto key : keys)
+        {
+            if (threadShouldExit())
+                return;
+
+            // Only render with pitches for the rate the cache was prepared at
+            if ((*slotStorage)[(size_t) key].load() == nullptr
+                && pitches.object->sampleRate == sampleRate
+                && FidgetAudioProcessor::isNoteCacheable ((*mapping.object)[(size_t) (key / 128)]))
+                render (key, *mapping.object, *pitches.object, mapping.generation, pitches.generation);
+        }
+
+        evictToLimit();
+        freeRetired();
+    }
+}
+
+void NoteCache::render (int key, const FidgetAudioProcessor::NoteWeirdnessTable& table, const FidgetAudioProcessor::PitchTable& pitches,
+                        juce::uint32 mappingGeneration, juce::uint32 tuningGeneration)
+{
+    const int note = key / 128;
+    const int knobPosition = key % 128;
+    const auto& nw = table[(size_t) note];
+
+    const int attackLength = juce::roundToInt (attackSeconds * sampleRate);
+    const int loopLength = juce::roundToInt (loopSeconds * sampleRate);
+    const int crossfadeLength = juce::jmin (attackLength, juce::roundToInt (loopCrossfadeSeconds * sampleRate));
+
+    auto entry = std::make_unique<Entry>();
+    entry->key = key;
+    entry->mappingGeneration = mappingGeneration;
+    entry->tuningGeneration = tuningGeneration;
+    entry->loopStart = attackLength;
+    entry->samples.resize ((size_t) (attackLength + loopLength));
+    entry->lastUsed = useClock.load();
+
+    // Exactly what the live voice plays after a note-on at this knob position
+    renderVoice->reset();
+    renderVoice->startNote (pitches.notes[(size_t) note]);
+    for (auto& sample : entry->samples)
+        sample = renderVoice->renderSample (nw, nw.randomAmounts[(size_t) knobPosition],
+                                            nw.randomCutoffs[(size_t) knobPosition],
+                                            nw.randomResonances[(size_t) knobPosition]);
+
+    // Blend the end of the loop into the samples leading up to its start,
+    // so jumping back to loopStart is seamless
+    auto* samples = entry->samples.data();
+    for (int i = 0; i < crossfadeLength; ++i)
+    {
+        const float t = (i + 0.5f) / crossfadeLength;
+        auto& tail = samples[attackLength + loopLength - crossfadeLength + i];
+        tail = tail * (1.0f - t) + samples[attackLength - crossfadeLength + i] * t;
+    }
+
+    bytesUsed += entry->samples.size() * sizeof (float);
+    (*slotStorage)[(size_t) key].store (entry.get());
+    entries.push_back (std::move (entry));
+}
+
+void NoteCache::evictStale (juce::uint32 mappingGeneration, juce::uint32 tuningGeneration)
+{
+    for (auto it = entries.begin(); it != entries.end();)
+    {
+        if ((*it)->mappingGeneration != mappingGeneration || (*it)->tuningGeneration != tuningGeneration)
+            it = evict (it);
+        else
+            ++it;
+    }
+}
+
+void NoteCache::evictToLimit()
+{
+    while (bytesUsed > memoryLimit.load() && ! entries.empty())
+    {
+        evict (std::min_element (entries.begin(), entries.end(), [] (const auto& a, const auto& b)
+        {
+            return a->lastUsed.load (std::memory_order_relaxed) < b->lastUsed.load (std::memory_order_relaxed);
+        }));
+    }
+}
+
+std::vector<std::unique_ptr<NoteCache::Entry>>::iterator NoteCache::evict (std::vector<std::unique_ptr<Entry>>::iterator entry)
+{
+    (*slotStorage)[(size_t) (*entry)->key].store (nullptr);
+    bytesUsed -= (*entry)->samples.size() * sizeof (float);
+    retired.push_back (std::move (*entry));
+    return entries.erase (entry);
+}
+
+void NoteCache::freeRetired()
+{
+    // An entry unpublished above may still be playing; it goes on the next pass
+    const auto* inUse = pinned.load();
+    retired.erase (std::remove_if (retired.begin(), retired.end(),
+                                   [inUse] (const auto& e) { return e.get() != inUse; }),
+                   retired.end());
+}
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+
+// Pool of pre-rendered "frozen" notes. For notes whose output only depends on
+// (note, knob position, sample rate, time since note-on), a background thread
+// renders the attack followed by a sustain segment whose end is crossfaded into
+// its start, so the audio thread can loop it from memory instead of running the DSP.
+//
+// The audio thread never allocates, locks or frees: lookups are atomic loads, and
+// an evicted entry is only freed once the audio thread no longer has it pinned.
+// Nothing is allocated and no thread runs until the cache is first switched on.
+class NoteCache : private juce::Thread
+{
+public:
+    struct Entry
+    {
+        std::vector<float> samples; // attack, then the sustain loop
+        int loopStart = 0;
+        int key = 0;
+        juce::uint32 mappingGeneration = 0;  // the note mapping it was rendered from
+        juce::uint32 tuningGeneration = 0;   // and the pitch table
+        std::atomic<juce::uint32> lastUsed { 0 };
+    };
+
+    explicit NoteCache (const FidgetAudioProcessor& processor);
+    ~NoteCache() override;
+
+    // Never called while the audio thread is processing
+    void prepare (double sampleRate);
+    void release();
+
+    // Message thread. Switching on allocates the slots and starts rendering; switching
+    // off stops the thread and drops every entry that is not playing.
+    void setEnabled (bool shouldBeEnabled);
+
+    void setMemoryLimit (size_t bytes) noexcept { memoryLimit = bytes; }
+
+    // Audio thread. Returns the note rendered from the given mapping and tuning and pins it until the
+    // next acquire() or unpin(); on a miss the note is queued for rendering and nullptr is returned.
+    const Entry* acquire (int midiNote, int knobPosition, juce::uint32 mappingGeneration, juce::uint32 tuningGeneration) noexcept;
+    void unpin() noexcept { pinned.store (nullptr); }
+
+private:
+    static constexpr int numKeys = 128 * 128;
+    static constexpr int requestQueueSize = 256;
+    static constexpr double attackSeconds = 0.25;
+    static constexpr double loopSeconds = 1.0;
+    static constexpr double loopCrossfadeSeconds = 0.05;
+
+    using Slots = std::array<std::atomic<Entry*>, numKeys>;
+
+    void startRendering();
+    void stopRendering();
+    void discardRequests();
+    void run() override;
+    void render (int key, const FidgetAudioProcessor::NoteWeirdnessTable& table, const FidgetAudioProcessor::PitchTable& pitches,
+                 juce::uint32 mappingGeneration, juce::uint32 tuningGeneration);
+    void evictStale (juce::uint32 mappingGeneration, juce::uint32 tuningGeneration);
+    void evictToLimit();
+    std::vector<std::unique_ptr<Entry>>::iterator evict (std::vector<std::unique_ptr<Entry>>::iterator entry);
+    void freeRetired();
+
+    const FidgetAudioProcessor& owner;
+    juce::CriticalSection stateLock;             // serialises prepare, release and setEnabled
+    bool enabled = false;
+    bool prepared = false;
+    std::unique_ptr<FidgetAudioProcessor::Voice> renderVoice;
+    double sampleRate = 44100.0;
+
+    std::unique_ptr<Slots> slotStorage;          // allocated when first enabled, kept until destruction
+    std::atomic<Slots*> slots { nullptr };
+    std::atomic<const Entry*> pinned { nullptr };
+    std::atomic<juce::uint32> useClock { 0 };
+    std::atomic<size_t> memoryLimit { 64 * 1024 * 1024 };
+
+    juce::AbstractFifo requests { requestQueueSize };
+    std::array<int, requestQueueSize> requestKeys {};
+
+    // Background thread only
+    std::vector<std::unique_ptr<Entry>> entries;
+    std::vector<std::unique_ptr<Entry>> retired;
+    size_t bytesUsed = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (NoteCache)
+};
\ No newline at end of file
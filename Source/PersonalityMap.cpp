@@ -0,0 +1,308 @@
+#include "PersonalityMap.h"
+
+namespace
+{
+    // Limits keep a typo or a damaged file from producing a map that only outputs silence or blows up
+    struct Limits { float minimum, maximum; };
+
+    constexpr Limits wobbleRateLimits   { 0.0f, 100.0f };
+    constexpr Limits glitchChanceLimits { 0.0f, 1.0f };
+    constexpr Limits harmonicMixLimits  { 0.0f, 32.0f };
+    constexpr Limits ringModFreqLimits  { 0.0f, 20000.0f };
+    constexpr Limits filterFreqLimits   { 20.0f, 20000.0f };
+    constexpr Limits bitDepthLimits     { 1.0f, 24.0f };
+    constexpr Limits grainSizeLimits    { 0.0005f, 1.0f };
+    constexpr Limits amountLimits       { 0.0f, 1.0f };
+    constexpr Limits cutoffLimits       { 20.0f, 20000.0f };
+    constexpr Limits resonanceLimits    { 0.0f, 0.99f };
+
+    float limit (Limits limits, float value) noexcept
+    {
+        return juce::jlimit (limits.minimum, limits.maximum, value);
+    }
+
+    template <typename Enum>
+    bool parseTypeName (const juce::var& value, int numTypes, const char* (*getName) (Enum), Enum& result)
+    {
+        // Either the index or the name shown in the editor, ignoring case and spaces
+        if (value.isInt() || value.isDouble())
+        {
+            const int index = (int) value;
+            if (! juce::isPositiveAndBelow (index, numTypes))
+                return false;
+
+            result = static_cast<Enum> (index);
+            return true;
+        }
+
+        const auto name = value.toString().removeCharacters (" ");
+        for (int i = 0; i < numTypes; ++i)
+        {
+            if (name.equalsIgnoreCase (juce::String (getName (static_cast<Enum> (i))).removeCharacters (" ")))
+            {
+                result = static_cast<Enum> (i);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool parseRange (const juce::var& value, Limits limits, PersonalityMap::Range& range)
+    {
+        if (! value.isArray() || value.size() != 2)
+            return false;
+
+        range.low = limit (limits, (float) value[0]);
+        range.high = limit (limits, (float) value[1]);
+        return true;
+    }
+
+    juce::Result parseNote (const juce::var& json, PersonalityMap::Note& note)
+    {
+        using Processor = PersonalityMap::Processor;
+
+        if (! json.isObject())
+            return juce::Result::fail ("expected an object");
+
+        auto has = [&json] (const char* name) { return json.hasProperty (name); };
+
+        if (has ("weird") && ! parseTypeName (json["weird"], (int) Processor::WeirdType::NUM_TYPES,
+                                              &Processor::getWeirdTypeName, note.type))
+            return juce::Result::fail ("unknown weird type " + json["weird"].toString().quoted());
+
+        if (has ("wave") && ! parseTypeName (json["wave"], (int) Processor::WaveType::NUM_WAVE_TYPES,
+                                             &Processor::getWaveTypeName, note.waveType))
+            return juce::Result::fail ("unknown wave type " + json["wave"].toString().quoted());
+
+        if (has ("filter") && ! parseTypeName (json["filter"], (int) Processor::FilterType::NUM_FILTER_TYPES,
+                                               &Processor::getFilterTypeName, note.filterType))
+            return juce::Result::fail ("unknown filter type " + json["filter"].toString().quoted());
+
+        auto readAmount = [&] (const char* name, Limits limits, float& amount)
+        {
+            if (has (name))
+                amount = limit (limits, (float) json[name]);
+        };
+
+        readAmount ("wobbleRate",   wobbleRateLimits,   note.wobbleRate);
+        readAmount ("glitchChance", glitchChanceLimits, note.glitchChance);
+        readAmount ("harmonicMix",  harmonicMixLimits,  note.harmonicMix);
+        readAmount ("ringModFreq",  ringModFreqLimits,  note.ringModFreq);
+        readAmount ("filterFreq",   filterFreqLimits,   note.filterFreq);
+        readAmount ("bitDepth",     bitDepthLimits,     note.bitDepth);
+        readAmount ("grainSize",    grainSizeLimits,    note.grainSize);
+
+        if (has ("amount") && ! parseRange (json["amount"], amountLimits, note.amount))
+            return juce::Result::fail ("\"amount\" must be [low, high]");
+
+        if (has ("cutoff") && ! parseRange (json["cutoff"], cutoffLimits, note.cutoff))
+            return juce::Result::fail ("\"cutoff\" must be [low, high]");
+
+        if (has ("resonance") && ! parseRange (json["resonance"], resonanceLimits, note.resonance))
+            return juce::Result::fail ("\"resonance\" must be [low, high]");
+
+        return juce::Result::ok();
+    }
+
+    int getPitchClass (const juce::String& name)
+    {
+        static const char* names[] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+        for (int i = 0; i < 12; ++i)
+            if (name.equalsIgnoreCase (names[i]))
+                return i;
+        return -1;
+    }
+
+    // Moves a value spread over one range to the same relative place in another
+    float rescale (float value, PersonalityMap::Range from, PersonalityMap::Range to)
+    {
+        return to.low + (value - from.low) / (from.high - from.low) * (to.high - to.low);
+    }
+}
+
+PersonalityMap PersonalityMap::fromTable (const Processor::NoteWeirdnessTable& table)
+{
+    PersonalityMap map;
+    for (size_t i = 0; i < table.size(); ++i)
+    {
+        const auto& nw = table[i];
+        auto& note = map.notes[i];
+        note.type = nw.type;
+        note.waveType = nw.waveType;
+        note.filterType = nw.filterType;
+        note.wobbleRate = nw.wobbleRate;
+        note.glitchChance = nw.glitchChance;
+        note.harmonicMix = nw.harmonicMix;
+        note.ringModFreq = nw.ringModFreq;
+        note.filterFreq = nw.filterFreq;
+        note.bitDepth = nw.bitDepth;
+        note.grainSize = nw.grainSize;
+    }
+    return map;
+}
+
+juce::Result PersonalityMap::load (const juce::File& file)
+{
+    juce::FileInputStream in (file);
+    if (! in.openedOk())
+        return juce::Result::fail ("cannot open " + file.getFullPathName());
+
+    if (in.getTotalLength() >= 8 && in.readInt() == binaryMagic)
+        return readBinary (in);
+
+    in.setPosition (0);
+    return parseJson (in.readEntireStreamAsString());
+}
+
+juce::Result PersonalityMap::parseJson (const juce::String& text)
+{
+    juce::var json;
+    auto result = juce::JSON::parse (text, json);
+    if (result.failed())
+        return result;
+
+    auto* entries = json["notes"].getDynamicObject();
+    if (entries == nullptr)
+        return juce::Result::fail ("expected a \"notes\" object");
+
+    // Work on a copy, so a map with errors leaves this one untouched
+    auto parsed = notes;
+
+    // Broadest first, so single notes override pitch classes and pitch classes override "all"
+    for (int pass = 0; pass < 3; ++pass)
+    {
+        for (auto& entry : entries->getProperties())
+        {
+            const auto key = entry.name.toString();
+            const int pitchClass = getPitchClass (key);
+            const bool isNote = key.isNotEmpty() && key.containsOnly ("0123456789");
+
+            if (! isNote && pitchClass < 0 && ! key.equalsIgnoreCase ("all"))
+                return juce::Result::fail ("unknown note " + key.quoted());
+
+            if (pass != (key.equalsIgnoreCase ("all") ? 0 : pitchClass >= 0 ? 1 : 2))
+                continue;
+
+            if (isNote && ! juce::isPositiveAndBelow (key.getIntValue(), 128))
+                return juce::Result::fail ("note " + key + " is outside 0-127");
+
+            for (int i = 0; i < 128; ++i)
+            {
+                const bool matches = pass == 0 || (pass == 1 ? i % 12 == pitchClass : i == key.getIntValue());
+                if (! matches)
+                    continue;
+
+                result = parseNote (entry.value, parsed[(size_t) i]);
+                if (result.failed())
+                    return juce::Result::fail (key + ": " + result.getErrorMessage());
+            }
+        }
+    }
+
+    notes = parsed;
+    return juce::Result::ok();
+}
+
+juce::Result PersonalityMap::readBinary (juce::InputStream& in)
+{
+    // Magic already consumed by the caller
+    const int version = in.readInt();
+    if (version < 1 || version > binaryVersion)
+        return juce::Result::fail ("unsupported map version " + juce::String (version));
+
+    const int bytesPerNote = 3 + 13 * (int) sizeof (float);
+    if (in.getNumBytesRemaining() < 128 * bytesPerNote)
+        return juce::Result::fail ("map is truncated");
+
+    // Held to the same limits as JSON maps; a NaN or infinity means the file is damaged
+    bool finite = true;
+    auto readType = [&in] (int numTypes) { return juce::jmin<int> ((juce::uint8) in.readByte(), numTypes - 1); };
+    auto readAmount = [&in, &finite] (Limits limits)
+    {
+        const float value = in.readFloat();
+        finite = finite && std::isfinite (value);
+        return limit (limits, value);
+    };
+    auto readRange = [&readAmount] (Limits limits) { Range r; r.low = readAmount (limits); r.high = readAmount (limits); return r; };
+
+    // Read into a copy, so a damaged file leaves this map as it was
+    auto parsed = notes;
+    for (auto& note : parsed)
+    {
+        note.type = static_cast<Processor::WeirdType> (readType ((int) Processor::WeirdType::NUM_TYPES));
+        note.waveType = static_cast<Processor::WaveType> (readType ((int) Processor::WaveType::NUM_WAVE_TYPES));
+        note.filterType = static_cast<Processor::FilterType> (readType ((int) Processor::FilterType::NUM_FILTER_TYPES));
+        note.wobbleRate = readAmount (wobbleRateLimits);
+        note.glitchChance = readAmount (glitchChanceLimits);
+        note.harmonicMix = readAmount (harmonicMixLimits);
+        note.ringModFreq = readAmount (ringModFreqLimits);
+        note.filterFreq = readAmount (filterFreqLimits);
+        note.bitDepth = readAmount (bitDepthLimits);
+        note.grainSize = readAmount (grainSizeLimits);
+        note.amount = readRange (amountLimits);
+        note.cutoff = readRange (cutoffLimits);
+        note.resonance = readRange (resonanceLimits);
+    }
+
+    if (! finite)
+        return juce::Result::fail ("map contains values that are not finite");
+
+    notes = parsed;
+    return juce::Result::ok();
+}
+
+void PersonalityMap::writeBinary (juce::OutputStream& out) const
+{
+    out.writeInt (binaryMagic);
+    out.writeInt (binaryVersion);
+
+    auto writeRange = [&out] (Range r) { out.writeFloat (r.low); out.writeFloat (r.high); };
+
+    for (const auto& note : notes)
+    {
+        out.writeByte ((char) note.type);
+        out.writeByte ((char) note.waveType);
+        out.writeByte ((char) note.filterType);
+        out.writeFloat (note.wobbleRate);
+        out.writeFloat (note.glitchChance);
+        out.writeFloat (note.harmonicMix);
+        out.writeFloat (note.ringModFreq);
+        out.writeFloat (note.filterFreq);
+        out.writeFloat (note.bitDepth);
+        out.writeFloat (note.grainSize);
+        writeRange (note.amount);
+        writeRange (note.cutoff);
+        writeRange (note.resonance);
+    }
+}
+
+void PersonalityMap::applyTo (Processor::NoteWeirdnessTable& table) const
+{
+    for (size_t i = 0; i < table.size(); ++i)
+    {
+        const auto& note = notes[i];
+        auto& nw = table[i];
+        nw.type = note.type;
+        nw.waveType = note.waveType;
+        nw.filterType = note.filterType;
+        nw.wobbleRate = note.wobbleRate;
+        nw.glitchChance = note.glitchChance;
+        nw.harmonicMix = note.harmonicMix;
+        nw.ringModFreq = note.ringModFreq;
+        nw.filterFreq = note.filterFreq;
+        nw.bitDepth = note.bitDepth;
+        nw.grainSize = note.grainSize;
+
+        // Untouched ranges keep the table's values exactly
+        for (size_t knob = 0; knob < nw.randomAmounts.size(); ++knob)
+        {
+            if (! (note.amount == defaultAmountRange))
+                nw.randomAmounts[knob] = rescale (nw.randomAmounts[knob], defaultAmountRange, note.amount);
+            if (! (note.cutoff == defaultCutoffRange))
+                nw.randomCutoffs[knob] = rescale (nw.randomCutoffs[knob], defaultCutoffRange, note.cutoff);
+            if (! (note.resonance == defaultResonanceRange))
+                nw.randomResonances[knob] = rescale (nw.randomResonances[knob], defaultResonanceRange, note.resonance);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+
+// A user-supplied note personality map: for every MIDI note its weird, wave and filter
+// type, its per-note amounts, and the ranges its per-knob amounts, cutoffs and
+// resonances are spread over. Maps are read on the message thread and applied to a
+// program's table by the program loader, so the audio thread only ever sees the result.
+//
+// JSON maps only need to mention what they change, under "notes":
+//
+//   { "notes": {
+//       "all": { "filter": "Low Pass" },
+//       "C#":  { "weird": "Glitcher", "glitchChance": 0.5 },
+//       "60":  { "wave": "Supersaw", "cutoff": [200, 2000], "resonance": [0.2, 0.6] } } }
+//
+// "all" applies first, then pitch classes (every octave), then single notes. Binary maps
+// (see writeBinary) hold every field of every note and are what session state stores.
+struct PersonalityMap
+{
+    using Processor = FidgetAudioProcessor;
+
+    struct Range
+    {
+        float low, high;
+        bool operator== (const Range& other) const noexcept  { return low == other.low && high == other.high; }
+    };
+
+    // The ranges the built-in hash spreads values over
+    static constexpr Range defaultAmountRange    { 0.0f, 1.0f };
+    static constexpr Range defaultCutoffRange    { 100.0f, 8100.0f };
+    static constexpr Range defaultResonanceRange { 0.0f, 0.95f };
+
+    struct Note
+    {
+        Processor::WeirdType type = Processor::WeirdType::Wobbler;
+        Processor::WaveType waveType = Processor::WaveType::Sine;
+        Processor::FilterType filterType = Processor::FilterType::LowPass;
+        float wobbleRate = 0.0f;
+        float glitchChance = 0.0f;
+        float harmonicMix = 0.0f;
+        float ringModFreq = 0.0f;
+        float filterFreq = 0.0f;
+        float bitDepth = 0.0f;
+        float grainSize = 0.0f;
+        Range amount = defaultAmountRange;
+        Range cutoff = defaultCutoffRange;
+        Range resonance = defaultResonanceRange;
+    };
+
+    std::array<Note, 128> notes;
+
+    // A map that reproduces the table, for JSON maps to start from
+    static PersonalityMap fromTable (const Processor::NoteWeirdnessTable& table);
+
+    // Reads a JSON or binary map file over this one
+    juce::Result load (const juce::File& file);
+    juce::Result parseJson (const juce::String& json);
+    juce::Result readBinary (juce::InputStream& in);
+    void writeBinary (juce::OutputStream& out) const;
+
+    // Replaces the table's types and amounts, and rescales its per-knob values into the ranges
+    void applyTo (Processor::NoteWeirdnessTable& table) const;
+
+    static constexpr int binaryMagic = 0x4d474446; // "FDGM"
+    static constexpr int binaryVersion = 1;
+};
\ No newline at end of file
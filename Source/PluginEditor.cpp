@@ -14,6 +14,28 @@ FidgetAudioProcessorEditor::FidgetAudioProcessorEditor (FidgetAudioProcessor& p)
     weirdnessAttachment.reset(new juce::AudioProcessorValueTreeState::SliderAttachment(
         audioProcessor.getParameters(), "weirdness", weirdnessKnob));
     
+    // Frozen-voice playback toggle
+    addAndMakeVisible(noteCacheButton);
+    noteCacheAttachment.reset(new juce::AudioProcessorValueTreeState::ButtonAttachment(
+        audioProcessor.getParameters(), "noteCache", noteCacheButton));
+    
+    // CPU governor toggle
+    addAndMakeVisible(autoQualityButton);
+    autoQualityAttachment.reset(new juce::AudioProcessorValueTreeState::ButtonAttachment(
+        audioProcessor.getParameters(), "autoQuality", autoQualityButton));
+    
+    // Personality map loading
+    addAndMakeVisible(mapButton);
+    mapButton.onClick = [this] { showMapMenu(); };
+    
+    // Scala tuning loading
+    addAndMakeVisible(tuningButton);
+    tuningButton.onClick = [this] { showTuningMenu(); };
+    
+    // Modulation matrix loading
+    addAndMakeVisible(modulationButton);
+    modulationButton.onClick = [this] { showModulationMenu(); };
+    
     setSize (400, 400);
     startTimerHz(30); // Update UI 30 times per second
 }
@@ -33,6 +55,26 @@ void FidgetAudioProcessorEditor::paint (juce::Graphics& g)
     g.setFont (28.0f);
     g.drawFittedText ("FIDGET", getLocalBounds().removeFromTop(50), juce::Justification::centred, 1);
     
+    // Quality tier picked by the CPU governor
+    auto qualityTier = audioProcessor.getCurrentQualityTier();
+    g.setFont(12.0f);
+    g.setColour(qualityTier == FidgetAudioProcessor::QualityTier::Full ? juce::Colours::grey
+              : qualityTier == FidgetAudioProcessor::QualityTier::Reduced ? juce::Colours::orange
+              : juce::Colours::red);
+    g.drawText("Quality: " + juce::String(audioProcessor.getQualityTierName(qualityTier)),
+               getLocalBounds().removeFromTop(20).reduced(8, 0), juce::Justification::centredRight);
+    
+    // Loaded personality map, or why the last reload failed
+    auto mapError = audioProcessor.getPersonalityMapError();
+    g.setColour(mapError.isNotEmpty() ? juce::Colours::red : juce::Colours::grey);
+    g.drawText(mapError.isNotEmpty() ? mapError : audioProcessor.getPersonalityMapFile().getFileName(),
+               juce::Rectangle<int>(8, 26, getWidth() / 2 - 60, 16), juce::Justification::centredLeft);
+    
+    // Current tuning
+    g.setColour(juce::Colours::grey);
+    g.drawText(audioProcessor.getTuningName(),
+               juce::Rectangle<int>(getWidth() / 2 + 60, 26, getWidth() / 2 - 136, 16), juce::Justification::centredRight);
+    
     int currentNote = audioProcessor.getCurrentNote();
     if (currentNote >= 0)
     {
@@ -122,15 +164,134 @@ void FidgetAudioProcessorEditor::resized()
     // Position the knob
     int knobSize = 100;
     weirdnessKnob.setBounds((getWidth() - knobSize) / 2, 200, knobSize, knobSize);
+    noteCacheButton.setBounds(getWidth() / 2 - 115, 310, 110, 24);
+    autoQualityButton.setBounds(getWidth() / 2 + 5, 310, 110, 24);
+    mapButton.setBounds(8, 4, 60, 20);
+    tuningButton.setBounds(getWidth() - 68, 24, 60, 20);
+    modulationButton.setBounds(getWidth() - 68, 48, 60, 20);
 }
 
 void FidgetAudioProcessorEditor::timerCallback()
 {
-    // Only repaint if the note has changed
+    // Only repaint if the note, quality tier, map or tuning has changed
     int currentNote = audioProcessor.getCurrentNote();
-    if (currentNote != lastNote)
+    auto qualityTier = audioProcessor.getCurrentQualityTier();
+    auto mapStatus = getMapStatus();
+    auto tuningName = audioProcessor.getTuningName();
+    if (currentNote != lastNote || qualityTier != lastQualityTier || mapStatus != lastMapStatus || tuningName != lastTuningName)
     {
         lastNote = currentNote;
+        lastQualityTier = qualityTier;
+        lastMapStatus = mapStatus;
+        lastTuningName = tuningName;
         repaint();
     }
+}
+
+juce::String FidgetAudioProcessorEditor::getMapStatus() const
+{
+    return audioProcessor.getPersonalityMapFile().getFullPathName() + audioProcessor.getPersonalityMapError();
+}
+
+void FidgetAudioProcessorEditor::showMapMenu()
+{
+    juce::PopupMenu menu;
+    menu.addItem(1, "Load personality map...");
+    menu.addItem(2, "Export as binary map...");
+    menu.addItem(3, "Clear personality map");
+    
+    menu.showMenuAsync(juce::PopupMenu::Options().withTargetComponent(&mapButton), [this](int result)
+    {
+        if (result == 3)
+        {
+            audioProcessor.clearPersonalityMap();
+            return;
+        }
+        
+        if (result != 1 && result != 2)
+            return;
+        
+        const bool load = result == 1;
+        mapChooser = std::make_unique<juce::FileChooser>(load ? "Load a personality map" : "Export a binary personality map",
+                                                         audioProcessor.getPersonalityMapFile(), load ? "*.json;*.fdgm" : "*.fdgm");
+        mapChooser->launchAsync((load ? juce::FileBrowserComponent::openMode : juce::FileBrowserComponent::saveMode)
+                                    | juce::FileBrowserComponent::canSelectFiles,
+                                [this, load](const juce::FileChooser& chooser)
+        {
+            auto file = chooser.getResult();
+            if (file == juce::File())
+                return;
+            
+            if (load)
+                audioProcessor.loadPersonalityMap(file);
+            else
+                audioProcessor.savePersonalityMap(file.withFileExtension("fdgm"));
+            repaint();
+        });
+    });
+}
+
+void FidgetAudioProcessorEditor::showTuningMenu()
+{
+    juce::PopupMenu menu;
+    menu.addItem(1, "Load Scala tuning...");
+    menu.addItem(2, "Reset to 12-TET");
+    
+    menu.showMenuAsync(juce::PopupMenu::Options().withTargetComponent(&tuningButton), [this](int result)
+    {
+        if (result == 2)
+        {
+            audioProcessor.resetTuning();
+            return;
+        }
+        
+        if (result != 1)
+            return;
+        
+        tuningChooser = std::make_unique<juce::FileChooser>("Load a Scala tuning", juce::File(), "*.scl");
+        tuningChooser->launchAsync(juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles,
+                                   [this](const juce::FileChooser& chooser)
+        {
+            auto scale = chooser.getResult();
+            if (scale == juce::File())
+                return;
+            
+            // A keyboard mapping next to the scale with the same name is used with it
+            auto keyboardMapping = scale.withFileExtension("kbm");
+            audioProcessor.loadTuning(scale, keyboardMapping.existsAsFile() ? keyboardMapping : juce::File());
+            repaint();
+        });
+    });
+}
+
+void FidgetAudioProcessorEditor::showModulationMenu()
+{
+    juce::PopupMenu menu;
+    menu.addItem(1, "Load modulation...");
+    menu.addItem(2, "Clear modulation", ! audioProcessor.getModulation().isEmpty());
+    
+    menu.showMenuAsync(juce::PopupMenu::Options().withTargetComponent(&modulationButton), [this](int result)
+    {
+        if (result == 2)
+        {
+            audioProcessor.setModulation({});
+            return;
+        }
+        
+        if (result != 1)
+            return;
+        
+        modulationChooser = std::make_unique<juce::FileChooser>("Load modulation routes", juce::File(), "*.json");
+        modulationChooser->launchAsync(juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles,
+                                       [this](const juce::FileChooser& chooser)
+        {
+            auto file = chooser.getResult();
+            if (file == juce::File())
+                return;
+            
+            auto loaded = audioProcessor.loadModulation(file);
+            if (loaded.failed())
+                juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "Modulation", loaded.getErrorMessage());
+        });
+    });
 }
\ No newline at end of file
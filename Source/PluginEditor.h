@@ -17,10 +17,28 @@ public:
 private:
     FidgetAudioProcessor& audioProcessor;
     int lastNote = -1;
+    FidgetAudioProcessor::QualityTier lastQualityTier = FidgetAudioProcessor::QualityTier::Full;
+    juce::String lastMapStatus;
+    juce::String lastTuningName;
     
     // UI Components
     juce::Slider weirdnessKnob;
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> weirdnessAttachment;
+    juce::ToggleButton noteCacheButton { "Note Cache" };
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ButtonAttachment> noteCacheAttachment;
+    juce::ToggleButton autoQualityButton { "Auto Quality" };
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ButtonAttachment> autoQualityAttachment;
+    juce::TextButton mapButton { "Map..." };
+    std::unique_ptr<juce::FileChooser> mapChooser;
+    juce::TextButton tuningButton { "Tuning..." };
+    std::unique_ptr<juce::FileChooser> tuningChooser;
+    juce::TextButton modulationButton { "Mod..." };
+    std::unique_ptr<juce::FileChooser> modulationChooser;
+    
+    void showMapMenu();
+    void showTuningMenu();
+    void showModulationMenu();
+    juce::String getMapStatus() const;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FidgetAudioProcessorEditor)
 };
\ No newline at end of file
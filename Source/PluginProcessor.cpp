@@ -1,5 +1,9 @@
 #include "PluginProcessor.h"
-#include "PluginEditor.h"
+#if ! FIDGET_HEADLESS
+ #include "PluginEditor.h"
+#endif
+#include "NoteCache.h"
+#include "PersonalityMap.h"
 
 static juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout()
 {
@@ -8,52 +12,145 @@ static juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout
     params.push_back(std::make_unique<juce::AudioParameterFloat>(
         "weirdness", "Weirdness", 0.0f, 1.0f, 0.5f));
     
+    params.push_back(std::make_unique<juce::AudioParameterBool>(
+        "noteCache", "Note Cache", false));
+    
+    params.push_back(std::make_unique<juce::AudioParameterBool>(
+        "autoQuality", "Auto Quality", true));
+    
     return { params.begin(), params.end() };
 }
 
+// Parabolic sine approximation (~0.1% error), for the lowest quality tier
+static float fastSin(float x)
+{
+    const float pi = juce::MathConstants<float>::pi;
+    x -= 2.0f * pi * std::floor((x + pi) / (2.0f * pi));
+    float y = (4.0f / pi) * x - (4.0f / (pi * pi)) * x * std::abs(x);
+    return 0.225f * (y * std::abs(y) - y) + y;
+}
+
+// One optional output per weird type after the main one. Notes whose type has no
+// enabled output play on the main output. The effect build works in place, so it has none.
+static juce::AudioProcessor::BusesProperties withWeirdTypeOutputs(juce::AudioProcessor::BusesProperties buses)
+{
+   #if ! JucePlugin_IsMidiEffect && JucePlugin_IsSynth
+    for (int type = 0; type < static_cast<int>(FidgetAudioProcessor::WeirdType::NUM_TYPES); ++type)
+        buses = buses.withOutput(FidgetAudioProcessor::getWeirdTypeName(static_cast<FidgetAudioProcessor::WeirdType>(type)),
+                                 juce::AudioChannelSet::stereo(), false);
+   #endif
+    return buses;
+}
+
 FidgetAudioProcessor::FidgetAudioProcessor()
 #ifndef JucePlugin_PreferredChannelConfigurations
-     : AudioProcessor (BusesProperties()
+     : AudioProcessor (withWeirdTypeOutputs(BusesProperties()
                      #if ! JucePlugin_IsMidiEffect
                       #if ! JucePlugin_IsSynth
                        .withInput  ("Input",  juce::AudioChannelSet::stereo(), true)
                       #endif
                        .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
                      #endif
-                       ),
-       parameters(*this, nullptr, "Parameters", createParameterLayout()),
-       random(juce::Time::currentTimeMillis())
+                       )),
+       parameters(*this, nullptr, "Parameters", createParameterLayout())
 #endif
 {
     weirdnessParam = parameters.getRawParameterValue("weirdness");
-    initializeNoteWeirdness();
+    weirdnessParameter = parameters.getParameter("weirdness");
+    noteCacheParam = parameters.getRawParameterValue("noteCache");
+    autoQualityParam = parameters.getRawParameterValue("autoQuality");
+    setRandomSeed(juce::Time::currentTimeMillis());
+    noteCache = std::make_unique<NoteCache>(*this);
+    startTimer(500); // follows the note cache switch and the personality map file
+    
+    // Lets a trace be captured from any host without a rebuild
+    auto traceFile = juce::SystemStats::getEnvironmentVariable("FIDGET_TRACE_FILE", {});
+    if (traceFile.isNotEmpty())
+        trace.start(juce::File(traceFile));
 }
 
 FidgetAudioProcessor::~FidgetAudioProcessor()
 {
+    cancelPendingUpdate();
+}
+
+std::shared_ptr<const FidgetAudioProcessor::NoteWeirdnessTable> FidgetAudioProcessor::getDefaultNoteWeirdness()
+{
+    // The default table only depends on the note numbers, so it is built once per process
+    static const std::shared_ptr<const NoteWeirdnessTable> table = []
+    {
+        auto t = std::make_shared<NoteWeirdnessTable>();
+        initializeNoteWeirdness(*t, 0);
+        return t;
+    }();
+    
+    return table;
+}
+
+std::shared_ptr<const FidgetAudioProcessor::NoteWeirdnessTable> FidgetAudioProcessor::getNoteWeirdnessForVariation(int variation)
+{
+    if (variation == 0)
+        return getDefaultNoteWeirdness();
+    
+    // Instances on the same program share one table for as long as any of them uses it
+    static juce::CriticalSection lock;
+    static std::map<int, std::weak_ptr<const NoteWeirdnessTable>> tables;
+    
+    const juce::ScopedLock sl(lock);
+    if (auto existing = tables[variation].lock())
+        return existing;
+    
+    auto table = std::make_shared<NoteWeirdnessTable>();
+    initializeNoteWeirdness(*table, variation);
+    tables[variation] = table;
+    return table;
+}
+
+void FidgetAudioProcessor::prepareProgram(int index)
+{
+    // Program loader thread: everything the switch needs is built here, never on the audio thread
+    if (programClearsMap.exchange(false))
+        setPersonalityMap(nullptr, {});
+    
+    auto table = getNoteWeirdnessForVariation(programs.getProgram(index).mappingVariation);
+    
+    const juce::ScopedLock sl(mappingLock);
+    if (personalityMap != nullptr)
+    {
+        // A loaded map replaces the program's personalities but keeps its knob tables
+        auto mapped = std::make_shared<NoteWeirdnessTable>(*table);
+        personalityMap->applyTo(*mapped);
+        table = std::move(mapped);
+    }
+    
+    if (noteWeirdness.getLatest().object != table)
+        noteWeirdness.publish(std::move(table));
 }
 
-void FidgetAudioProcessor::initializeNoteWeirdness()
+void FidgetAudioProcessor::initializeNoteWeirdness(NoteWeirdnessTable& table, int variation)
 {
-    // Use deterministic "randomness" based on note number
+    // Use deterministic "randomness" based on note number; each variation
+    // reads the same hashes further along, so variation 0 is the original mapping
     for (int note = 0; note < 128; ++note)
     {
+        const int hashIndex = note + variation * 128;
+        
         // Create unique values for each note using hash-like operations
-        float seed1 = std::sin(note * 0.1234f) * 1000.0f;
-        float seed2 = std::cos(note * 0.5678f) * 1000.0f;
-        float seed3 = std::sin(note * 0.9876f) * 1000.0f;
+        float seed1 = std::sin(hashIndex * 0.1234f) * 1000.0f;
+        float seed2 = std::cos(hashIndex * 0.5678f) * 1000.0f;
+        float seed3 = std::sin(hashIndex * 0.9876f) * 1000.0f;
         
-        auto& nw = noteWeirdness[note];
+        auto& nw = table[note];
         
         // Assign weird type based on note
         int typeIndex = std::abs(static_cast<int>(seed1)) % static_cast<int>(WeirdType::NUM_TYPES);
         nw.type = static_cast<WeirdType>(typeIndex);
         
         // Assign wave type based on note in octave
-        nw.waveType = getWaveTypeForNote(note);
+        nw.waveType = getWaveTypeForNote(note + variation * 7);
         
         // Assign filter type based on note in octave
-        nw.filterType = getFilterTypeForNote(note);
+        nw.filterType = getFilterTypeForNote(note + variation * 5);
         
         // Set parameters for each type
         nw.wobbleRate = 0.5f + (seed1 - std::floor(seed1)) * 20.0f;
@@ -68,45 +165,409 @@ void FidgetAudioProcessor::initializeNoteWeirdness()
         for (int knobPos = 0; knobPos < 128; ++knobPos)
         {
             // Create unique random value for this note + knob position combination
-            float knobSeed = std::sin((note * 128 + knobPos) * 0.7654f) * 1000.0f;
+            float knobSeed = std::sin((hashIndex * 128 + knobPos) * 0.7654f) * 1000.0f;
             nw.randomAmounts[knobPos] = knobSeed - std::floor(knobSeed);
             
             // Random filter parameters
-            float filterSeed1 = std::sin((note * 128 + knobPos) * 0.4321f) * 1000.0f;
-            float filterSeed2 = std::cos((note * 128 + knobPos) * 0.8765f) * 1000.0f;
+            float filterSeed1 = std::sin((hashIndex * 128 + knobPos) * 0.4321f) * 1000.0f;
+            float filterSeed2 = std::cos((hashIndex * 128 + knobPos) * 0.8765f) * 1000.0f;
             nw.randomCutoffs[knobPos] = 100.0f + (filterSeed1 - std::floor(filterSeed1)) * 8000.0f; // 100Hz to 8100Hz
             nw.randomResonances[knobPos] = (filterSeed2 - std::floor(filterSeed2)) * 0.95f; // 0 to 0.95
         }
     }
 }
 
+std::shared_ptr<const FidgetAudioProcessor::PitchTable> FidgetAudioProcessor::createPitchTable(const Tuning& tuning, double sampleRate)
+{
+    auto table = std::make_shared<PitchTable>();
+    table->sampleRate = sampleRate;
+    
+    for (int note = 0; note < 128; ++note)
+    {
+        // Keep the oscillators below Nyquist whatever the scale asks for
+        auto& pitch = table->notes[note];
+        pitch.frequency = juce::jmin(static_cast<float>(tuning.getFrequency(note)), static_cast<float>(sampleRate * 0.49));
+        pitch.phaseIncrement = pitch.frequency / sampleRate;
+        pitch.subPhaseIncrement = (pitch.frequency * 0.5) / sampleRate; // Sub osc at half frequency
+        pitch.fmPhaseIncrement = (pitch.frequency * 2.0) / sampleRate; // FM at double frequency
+    }
+    
+    return table;
+}
+
+void FidgetAudioProcessor::publishPitchTable(std::shared_ptr<const Tuning> newTuning, double sampleRate)
+{
+    const juce::ScopedLock sl(tuningLock);
+    tuning = std::move(newTuning);
+    pitchTableSampleRate = sampleRate;
+    pitchTable.publish(createPitchTable(*tuning, sampleRate));
+}
+
+void FidgetAudioProcessor::updatePitchTable()
+{
+    // Retune the held note in place; its phases carry on
+    if (pitchTable.update() && currentNote >= 0)
+        for (auto& voice : voices)
+            voice.setPitch(pitchTable.getActive().notes[currentNote]);
+}
+
+juce::Result FidgetAudioProcessor::loadTuning(const juce::File& scale, const juce::File& keyboardMapping)
+{
+    auto newTuning = std::make_shared<Tuning>();
+    auto result = newTuning->load(scale, keyboardMapping);
+    if (result.wasOk())
+    {
+        const juce::ScopedLock sl(tuningLock);
+        publishPitchTable(std::move(newTuning), pitchTableSampleRate);
+    }
+    return result;
+}
+
+void FidgetAudioProcessor::resetTuning()
+{
+    const juce::ScopedLock sl(tuningLock);
+    publishPitchTable(std::make_shared<Tuning>(), pitchTableSampleRate);
+}
+
+juce::String FidgetAudioProcessor::getTuningName() const
+{
+    const juce::ScopedLock sl(tuningLock);
+    return tuning->getName();
+}
+
+void FidgetAudioProcessor::publishModulation(std::shared_ptr<const ModMatrix::Settings> settings, double sampleRate)
+{
+    const juce::ScopedLock sl(modulationLock);
+    modulation = std::move(settings);
+    modMatrixSampleRate = sampleRate;
+    modMatrix.publish(ModMatrix::compile(*modulation, sampleRate, maxSegmentSize));
+}
+
+void FidgetAudioProcessor::setModulation(const ModMatrix::Settings& settings)
+{
+    const juce::ScopedLock sl(modulationLock);
+    publishModulation(std::make_shared<ModMatrix::Settings>(settings), modMatrixSampleRate);
+}
+
+juce::Result FidgetAudioProcessor::loadModulation(const juce::File& file)
+{
+    if (! file.existsAsFile())
+        return juce::Result::fail("cannot open " + file.getFullPathName());
+    
+    ModMatrix::Settings settings;
+    auto result = settings.parseJson(file.loadFileAsString());
+    if (result.wasOk())
+        setModulation(settings);
+    return result;
+}
+
+ModMatrix::Settings FidgetAudioProcessor::getModulation() const
+{
+    const juce::ScopedLock sl(modulationLock);
+    return *modulation;
+}
+
+TraceRecorder::NoteInfo FidgetAudioProcessor::buildTraceInfo(int midiNote) const
+{
+    TraceRecorder::NoteInfo info;
+    if (midiNote >= 0 && midiNote < 128)
+    {
+        const auto& nw = noteWeirdness.getActive()[midiNote];
+        info.note = midiNote;
+        info.waveType = getWaveTypeName(nw.waveType);
+        info.weirdType = getWeirdTypeName(nw.type);
+        info.filterType = getFilterTypeName(nw.filterType);
+    }
+    return info;
+}
+
+bool FidgetAudioProcessor::isNoteCacheable(const NoteWeirdness& nw)
+{
+    // Noise is random, and the comb filter carries its delay line over from earlier notes
+    return nw.waveType != WaveType::WhiteNoise
+        && nw.waveType != WaveType::PinkNoise
+        && nw.waveType != WaveType::CrackleNoise
+        && nw.filterType != FilterType::Comb;
+}
+
+void FidgetAudioProcessor::setNoteCacheMemoryLimit(size_t bytes)
+{
+    noteCache->setMemoryLimit(bytes);
+}
+
+juce::Result FidgetAudioProcessor::loadPersonalityMap(const juce::File& file)
+{
+    // Parsed here, off the audio thread; whatever a JSON map leaves out keeps the program's values
+    auto table = getNoteWeirdnessForVariation(programs.getProgram(programs.getCurrentProgram()).mappingVariation);
+    auto map = std::make_shared<PersonalityMap>(PersonalityMap::fromTable(*table));
+    
+    auto result = map->load(file);
+    if (result.failed())
+    {
+        const juce::ScopedLock sl(mappingLock);
+        personalityMapError = result.getErrorMessage();
+        return result;
+    }
+    
+    setPersonalityMap(std::move(map), file);
+    programs.select(programs.getCurrentProgram());
+    return result;
+}
+
+juce::Result FidgetAudioProcessor::savePersonalityMap(const juce::File& file) const
+{
+    // Without a loaded map, the current program's personalities are exported
+    std::shared_ptr<const PersonalityMap> map;
+    {
+        const juce::ScopedLock sl(mappingLock);
+        map = personalityMap;
+    }
+    if (map == nullptr)
+        map = std::make_shared<PersonalityMap>(PersonalityMap::fromTable(*getNoteWeirdnessSnapshot().object));
+    
+    juce::FileOutputStream out(file);
+    if (! out.openedOk())
+        return juce::Result::fail("cannot write " + file.getFullPathName());
+    
+    out.truncate();
+    map->writeBinary(out);
+    out.flush();
+    return out.getStatus();
+}
+
+void FidgetAudioProcessor::clearPersonalityMap()
+{
+    setPersonalityMap(nullptr, {});
+    programs.select(programs.getCurrentProgram());
+}
+
+juce::File FidgetAudioProcessor::getPersonalityMapFile() const
+{
+    const juce::ScopedLock sl(mappingLock);
+    return personalityMapFile;
+}
+
+juce::String FidgetAudioProcessor::getPersonalityMapError() const
+{
+    const juce::ScopedLock sl(mappingLock);
+    return personalityMapError;
+}
+
+void FidgetAudioProcessor::setPersonalityMap(std::shared_ptr<const PersonalityMap> map, const juce::File& file)
+{
+    // A map set after a host's program pick wins over it
+    programClearsMap = false;
+    
+    {
+        const juce::ScopedLock sl(mappingLock);
+        personalityMap = std::move(map);
+        personalityMapFile = file;
+        personalityMapTime = file.getLastModificationTime();
+        personalityMapError = {};
+    }
+}
+
+void FidgetAudioProcessor::timerCallback()
+{
+    // The cache only allocates and runs its thread while it is switched on
+    noteCache->setEnabled(*noteCacheParam > 0.5f);
+    
+    juce::File file;
+    {
+        const juce::ScopedLock sl(mappingLock);
+        if (personalityMapFile == juce::File() || personalityMapFile.getLastModificationTime() == personalityMapTime)
+            return;
+        
+        // Only retried once the file changes again
+        personalityMapTime = personalityMapFile.getLastModificationTime();
+        file = personalityMapFile;
+    }
+    
+    // A broken edit leaves the previous map playing and is reported by getPersonalityMapError()
+    loadPersonalityMap(file);
+}
+
 FidgetAudioProcessor::WeirdType FidgetAudioProcessor::getCurrentWeirdType() const
 {
-    if (currentNote >= 0 && currentNote < 128)
-        return noteWeirdness[currentNote].type;
+    const int note = currentNote;
+    if (note >= 0 && note < 128)
+        return (*noteWeirdness.getLatest().object)[note].type;
     return WeirdType::Wobbler;
 }
 
 FidgetAudioProcessor::WaveType FidgetAudioProcessor::getCurrentWaveType() const
 {
-    if (currentNote >= 0 && currentNote < 128)
-        return noteWeirdness[currentNote].waveType;
+    const int note = currentNote;
+    if (note >= 0 && note < 128)
+        return (*noteWeirdness.getLatest().object)[note].waveType;
     return WaveType::Sine;
 }
 
 FidgetAudioProcessor::FilterType FidgetAudioProcessor::getCurrentFilterType() const
 {
-    if (currentNote >= 0 && currentNote < 128)
-        return noteWeirdness[currentNote].filterType;
+    const int note = currentNote;
+    if (note >= 0 && note < 128)
+        return (*noteWeirdness.getLatest().object)[note].filterType;
     return FilterType::LowPass;
 }
 
-float FidgetAudioProcessor::generateOscillator(WaveType type, float phase, float frequency)
+void FidgetAudioProcessor::Voice::prepare(double sampleRate)
+{
+    currentSampleRate = sampleRate;
+    updateIncrements();
+    granular.prepare(sampleRate);
+    glitch.prepare(sampleRate);
+}
+
+void FidgetAudioProcessor::Voice::updateIncrements()
+{
+    phaseIncrement = frequency / currentSampleRate;
+    subPhaseIncrement = (frequency * 0.5) / currentSampleRate; // Sub osc at half frequency
+    fmPhaseIncrement = (frequency * 2.0) / currentSampleRate; // FM at double frequency
+}
+
+void FidgetAudioProcessor::Voice::startNote(const NotePitch& pitch)
+{
+    setPitch(pitch);
+    resetPhases();
+}
+
+void FidgetAudioProcessor::Voice::setPitch(const NotePitch& pitch)
+{
+    frequency = pitch.frequency;
+    phaseIncrement = pitch.phaseIncrement;
+    subPhaseIncrement = pitch.subPhaseIncrement;
+    fmPhaseIncrement = pitch.fmPhaseIncrement;
+}
+
+void FidgetAudioProcessor::Voice::resetPhases()
+{
+    phase = 0.0;
+    phase2 = 0.0;
+    subPhase = 0.0;
+    fmPhase = 0.0;
+    wobblePhase = 0.0;
+    granular.reset();
+    glitch.reset();
+    filterState = 0.0f;
+    
+    // Reset supersaw phases with slight detuning
+    for (int i = 0; i < 7; ++i)
+    {
+        sawPhases[i] = 0.0;
+    }
+    
+    // Reset filter states
+    filterState1 = 0.0f;
+    filterState2 = 0.0f;
+    filterState3 = 0.0f;
+    filterState4 = 0.0f;
+    phaserPhase = 0.0;
+    for (int i = 0; i < 4; ++i)
+    {
+        phaserStages[i] = 0.0f;
+    }
+}
+
+void FidgetAudioProcessor::Voice::reset()
+{
+    bitCrushHold = 0.0f;
+    noiseState = 0.0f;
+    crackleTimer = 0.0f;
+    std::fill(std::begin(combDelay), std::end(combDelay), 0.0f);
+    combIndex = 0;
+    resetPhases();
+}
+
+void FidgetAudioProcessor::Voice::syncOscillators(const NoteWeirdness& nw, int samplesSinceNoteOn)
+{
+    auto wrap = [samplesSinceNoteOn](double increment)
+    {
+        double cycles = increment * samplesSinceNoteOn;
+        return cycles - std::floor(cycles);
+    };
+    
+    phase = wrap(phaseIncrement);
+    subPhase = wrap(subPhaseIncrement);
+    fmPhase = wrap(fmPhaseIncrement);
+    for (int i = 0; i < 7; ++i)
+    {
+        double detune = 1.0 + (i - 3) * 0.01;
+        sawPhases[i] = wrap(phaseIncrement * detune);
+    }
+    
+    // Each LFO only moves while its weird type or filter plays, at the rates used there
+    switch (nw.type)
+    {
+        case WeirdType::Wobbler: wobblePhase = wrap(nw.wobbleRate / currentSampleRate); break;
+        case WeirdType::FilterSweep: wobblePhase = wrap(0.5 / currentSampleRate); break;
+        case WeirdType::Harmonizer: phase2 = wrap((frequency * nw.harmonicMix) / currentSampleRate); break;
+        case WeirdType::RingMod: phase2 = wrap(nw.ringModFreq / currentSampleRate); break;
+        default: break;
+    }
+    
+    if (nw.filterType == FilterType::Phaser)
+        phaserPhase = wrap(0.5 / currentSampleRate);
+}
+
+int FidgetAudioProcessor::Voice::getSupersawSpread() const
+{
+    // Lower tiers keep only the saws closest to the centre
+    switch (quality)
+    {
+        case QualityTier::Full: return 3;
+        case QualityTier::Reduced: return 1;
+        default: return 0;
+    }
+}
+
+float FidgetAudioProcessor::Voice::sine(float radians) const
+{
+    return quality == QualityTier::Minimal ? fastSin(radians) : std::sin(radians);
+}
+
+float FidgetAudioProcessor::Voice::renderSample(const NoteWeirdness& nw, float weirdnessAmount, float cutoff, float resonance)
+{
+    // Generate oscillator based on wave type
+    return processSample(generateOscillator(nw.waveType, static_cast<float>(phase), frequency), nw, weirdnessAmount, cutoff, resonance);
+}
+
+float FidgetAudioProcessor::Voice::processSample(float input, const NoteWeirdness& nw, float weirdnessAmount, float cutoff, float resonance)
+{
+    // Apply weird processing with random amount
+    float weirdWave = processWeirdOscillator(input, nw, weirdnessAmount);
+    
+    // Apply chaos filter
+    float filtered = processChaosFilter(weirdWave, nw.filterType, cutoff, resonance);
+    
+    // Update phases
+    phase += phaseIncrement;
+    if (phase > 1.0) phase -= 1.0;
+    
+    subPhase += subPhaseIncrement;
+    if (subPhase > 1.0) subPhase -= 1.0;
+    
+    fmPhase += fmPhaseIncrement;
+    if (fmPhase > 1.0) fmPhase -= 1.0;
+    
+    // Update supersaw phases
+    const int spread = getSupersawSpread();
+    for (int i = 3 - spread; i <= 3 + spread; ++i)
+    {
+        double detune = 1.0 + (i - 3) * 0.01;
+        sawPhases[i] += (phaseIncrement * detune);
+        if (sawPhases[i] > 1.0) sawPhases[i] -= 1.0;
+    }
+    
+    return filtered;
+}
+
+float FidgetAudioProcessor::Voice::generateOscillator(WaveType type, float phase, float frequency)
 {
     switch (type)
     {
         case WaveType::Sine:
-            return std::sin(2.0f * juce::MathConstants<float>::pi * phase);
+            return sine(2.0f * juce::MathConstants<float>::pi * phase);
             
         case WaveType::Square:
             return phase < 0.5f ? 1.0f : -1.0f;
@@ -132,25 +593,25 @@ float FidgetAudioProcessor::generateOscillator(WaveType type, float phase, float
             
         case WaveType::Supersaw:
         {
+            const int spread = getSupersawSpread();
             float output = 0.0f;
-            for (int i = 0; i < 7; ++i)
+            for (int i = 3 - spread; i <= 3 + spread; ++i)
             {
-                float detune = 1.0f + (i - 3) * 0.01f;
-                output += 2.0f * sawPhases[i] - 1.0f;
+                output += 2.0f * static_cast<float>(sawPhases[i]) - 1.0f;
             }
-            return output / 7.0f;
+            return output / static_cast<float>(2 * spread + 1);
         }
             
         case WaveType::FM:
         {
-            float modulator = std::sin(2.0f * juce::MathConstants<float>::pi * fmPhase);
-            return std::sin(2.0f * juce::MathConstants<float>::pi * (phase + 0.5f * modulator));
+            float modulator = sine(2.0f * juce::MathConstants<float>::pi * static_cast<float>(fmPhase));
+            return sine(2.0f * juce::MathConstants<float>::pi * (phase + 0.5f * modulator));
         }
             
         case WaveType::SquareSub:
         {
             float square = phase < 0.5f ? 1.0f : -1.0f;
-            float sub = std::sin(2.0f * juce::MathConstants<float>::pi * subPhase);
+            float sub = sine(2.0f * juce::MathConstants<float>::pi * static_cast<float>(subPhase));
             return 0.7f * square + 0.3f * sub;
         }
             
@@ -212,34 +673,135 @@ double FidgetAudioProcessor::getTailLengthSeconds() const
 
 int FidgetAudioProcessor::getNumPrograms()
 {
-    return 1;
+    return programs.getNumPrograms();
 }
 
 int FidgetAudioProcessor::getCurrentProgram()
 {
-    return 0;
+    return programs.getCurrentProgram();
 }
 
 void FidgetAudioProcessor::setCurrentProgram (int index)
 {
+    if (! juce::isPositiveAndBelow(index, programs.getNumPrograms()))
+        return;
+    
+    // Hosts may call this on the audio thread, so the work is handed off: the loader builds the
+    // mapping and drops whatever personality map was loaded, and the knob is moved on the message
+    // thread, as setting a parameter takes its listener lock and calls back into the host
+    programClearsMap = true;
+    programs.select(index);
+    
+    pendingProgramWeirdness = programs.getWeirdness(index);
+    triggerAsyncUpdate();
+    if (juce::MessageManager::existsAndIsCurrentThread())
+        handleUpdateNowIfNeeded();
+}
+
+void FidgetAudioProcessor::handleAsyncUpdate()
+{
+    // The knob ramps to the program's value; the mapping follows once the loader has built it
+    const float weirdness = pendingProgramWeirdness.exchange(-1.0f);
+    if (weirdness >= 0.0f)
+        weirdnessParameter->setValueNotifyingHost(weirdnessParameter->convertTo0to1(weirdness));
 }
 
 const juce::String FidgetAudioProcessor::getProgramName (int index)
 {
-    return {};
+    return programs.getProgram(index).name;
 }
 
 void FidgetAudioProcessor::changeProgramName (int index, const juce::String& newName)
 {
+    programs.setProgramName(index, newName);
 }
 
 void FidgetAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
     currentSampleRate = sampleRate;
+    for (auto& voice : voices)
+        voice.prepare(sampleRate);
+    
+    // The layout only changes while we are not playing
+    for (int type = 0; type < static_cast<int>(WeirdType::NUM_TYPES); ++type)
+    {
+        auto* bus = getBus(false, type + 1);
+        weirdTypeChannels[static_cast<size_t>(type)] = bus != nullptr && bus->isEnabled()
+            ? getChannelIndexInProcessBlockBuffer(false, type + 1, 0) : 0;
+    }
+    parameterCache.valid = false;
+    
+    // Pitches are tabulated per sample rate; nothing is playing yet, so adopt it straight away
+    {
+        const juce::ScopedLock sl(tuningLock);
+        publishPitchTable(tuning, sampleRate);
+    }
+    pitchTable.update();
+    
+    // The same goes for the modulation rates
+    {
+        const juce::ScopedLock sl(modulationLock);
+        publishModulation(modulation, sampleRate);
+    }
+    modMatrix.update();
+    
+    // Cached notes are only valid at the rate they were rendered at
+    stopCachedNote();
+    noteCache->setEnabled(*noteCacheParam > 0.5f);
+    noteCache->prepare(sampleRate);
+    liveFadeLength = juce::jmax(1, static_cast<int>(0.01 * sampleRate)); // 10ms
+    liveWarmUpLength = static_cast<int>(0.02 * sampleRate); // 20ms, enough for the filters to settle
+    programFadeLength = juce::jmax(1, static_cast<int>(0.005 * sampleRate)); // 5ms each way
 }
 
 void FidgetAudioProcessor::releaseResources()
 {
+    stopCachedNote();
+    noteCache->release();
+}
+
+void FidgetAudioProcessor::reset()
+{
+    // Back to the just-constructed state, so a render never depends on what played before
+    currentNote = -1;
+    velocity = 0.0f;
+    envelope = 0.0f;
+    noteOn = false;
+    parameterCache.valid = false;
+    programGain = 1.0f;
+    programGainStep = 0.0f;
+    noteWeirdness.update();
+    pitchTable.update();
+    modMatrix.update();
+    modState = {};
+    stopCachedNote();
+    for (auto& voice : voices)
+        voice.reset();
+}
+
+void FidgetAudioProcessor::startCachedNote(int knobPosition)
+{
+    if (auto* entry = noteCache->acquire(currentNote, knobPosition, noteWeirdness.getActiveGeneration(), pitchTable.getActiveGeneration()))
+    {
+        cachedSamples = entry->samples.data();
+        cachedLength = static_cast<int>(entry->samples.size());
+        cachedLoopStart = entry->loopStart;
+        cachedPosition = 0;
+        cachedElapsed = 0;
+        cachedKnobPosition = knobPosition;
+        cachedTuning = pitchTable.getActiveGeneration();
+        trace.instant("noteCacheHit", getTraceInfo(currentNote));
+    }
+}
+
+void FidgetAudioProcessor::stopCachedNote()
+{
+    if (cachedSamples != nullptr)
+    {
+        cachedSamples = nullptr;
+        noteCache->unpin();
+    }
+    liveFadeRemaining = 0;
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -253,6 +815,14 @@ bool FidgetAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) c
      && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
         return false;
 
+    // Weird-type outputs are optional
+    for (int bus = 1; bus < layouts.outputBuses.size(); ++bus)
+    {
+        const auto set = layouts.getChannelSet(false, bus);
+        if (! set.isDisabled() && set != juce::AudioChannelSet::mono() && set != juce::AudioChannelSet::stereo())
+            return false;
+    }
+
    #if ! JucePlugin_IsSynth
     if (layouts.getMainOutputChannelSet() != layouts.getMainInputChannelSet())
         return false;
@@ -263,54 +833,41 @@ bool FidgetAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) c
 }
 #endif
 
-float FidgetAudioProcessor::processWeirdOscillator(float baseValue, int noteNumber, float weirdnessAmount)
+float FidgetAudioProcessor::Voice::processWeirdOscillator(float baseValue, const NoteWeirdness& nw, float weirdnessAmount)
 {
-    if (noteNumber < 0 || noteNumber >= 128) return baseValue;
-    
-    const auto& nw = noteWeirdness[noteNumber];
     float output = baseValue;
     
     switch (nw.type)
     {
         case WeirdType::Wobbler:
         {
-            float wobble = std::sin(wobblePhase * 2.0f * juce::MathConstants<float>::pi);
+            float wobble = std::sin(static_cast<float>(wobblePhase) * 2.0f * juce::MathConstants<float>::pi);
             float freqMod = 1.0f + (wobble * 0.8f * weirdnessAmount);  // Increased from 0.2f to 0.8f
             output = baseValue * freqMod;
             wobblePhase += nw.wobbleRate / currentSampleRate;
-            if (wobblePhase > 1.0f) wobblePhase -= 1.0f;
+            if (wobblePhase > 1.0) wobblePhase -= 1.0;
             break;
         }
         
         case WeirdType::Glitcher:
         {
-            glitchCounter++;
-            if (glitchCounter > currentSampleRate / 100)
-            {
-                glitchCounter = 0;
-                float random = std::sin(phase * 12345.6789f) * 1000.0f;
-                random = random - std::floor(random);
-                if (random < nw.glitchChance * weirdnessAmount)
-                {
-                    output = baseValue * ((random < 0.5f) ? -2.0f : 4.0f);  // More extreme glitches
-                }
-            }
+            output = glitch.process(baseValue, nw.glitchChance, weirdnessAmount);
             break;
         }
         
         case WeirdType::Harmonizer:
         {
-            float harmonic = std::sin(2.0f * juce::MathConstants<float>::pi * phase2);
+            float harmonic = std::sin(2.0f * juce::MathConstants<float>::pi * static_cast<float>(phase2));
             output = baseValue * (1.0f - weirdnessAmount * 0.8f) + 
                      harmonic * weirdnessAmount * 1.2f;  // Increased harmonic content
             phase2 += (frequency * nw.harmonicMix) / currentSampleRate;
-            if (phase2 > 1.0f) phase2 -= 1.0f;
+            if (phase2 > 1.0) phase2 -= 1.0;
             break;
         }
         
         case WeirdType::Reverser:
         {
-            float reverseAmount = std::sin(phase * juce::MathConstants<float>::pi * 16.0f);  // Doubled frequency
+            float reverseAmount = std::sin(static_cast<float>(phase) * juce::MathConstants<float>::pi * 16.0f);  // Doubled frequency
             output = baseValue * (1.0f - weirdnessAmount * 1.5f + reverseAmount * weirdnessAmount * 1.5f);
             break;
         }
@@ -325,36 +882,31 @@ float FidgetAudioProcessor::processWeirdOscillator(float baseValue, int noteNumb
         
         case WeirdType::RingMod:
         {
-            float ringMod = std::sin(2.0f * juce::MathConstants<float>::pi * phase2);
+            float ringMod = std::sin(2.0f * juce::MathConstants<float>::pi * static_cast<float>(phase2));
             output = baseValue * (1.0f - weirdnessAmount + ringMod * weirdnessAmount * 2.0f);  // Doubled intensity
             phase2 += nw.ringModFreq / currentSampleRate;
-            if (phase2 > 1.0f) phase2 -= 1.0f;
+            if (phase2 > 1.0) phase2 -= 1.0;
             break;
         }
         
         case WeirdType::Granular:
         {
-            grainPhase += 1.0f / (nw.grainSize * currentSampleRate);
-            if (grainPhase > 1.0f)
-            {
-                grainPhase = 0.0f;
-                phase = 0.0f;
-            }
-            float grainEnv = std::sin(grainPhase * juce::MathConstants<float>::pi);
-            output = baseValue * (1.0f - weirdnessAmount + grainEnv * weirdnessAmount * 2.0f);  // Doubled effect
+            // Fewer overlapping grains at lower quality tiers
+            const int grainLimit = quality == QualityTier::Full ? GranularEngine::maxGrains : (quality == QualityTier::Reduced ? 64 : 16);
+            output = granular.process(baseValue, nw.grainSize, weirdnessAmount, grainLimit);
             break;
         }
         
         case WeirdType::FilterSweep:
         {
-            float cutoff = nw.filterFreq * (1.0f + std::sin(wobblePhase * 2.0f * juce::MathConstants<float>::pi));
+            float cutoff = nw.filterFreq * (1.0f + std::sin(static_cast<float>(wobblePhase) * 2.0f * juce::MathConstants<float>::pi));
             float resonance = 10.0f * weirdnessAmount;  // Doubled from 5.0f to 10.0f
             float filterFreq = cutoff / currentSampleRate;
             filterState += (baseValue - filterState) * filterFreq;
             float highpass = baseValue - filterState;
             output = filterState + highpass * resonance;
-            wobblePhase += 0.5f / currentSampleRate;
-            if (wobblePhase > 1.0f) wobblePhase -= 1.0f;
+            wobblePhase += 0.5 / currentSampleRate;
+            if (wobblePhase > 1.0) wobblePhase -= 1.0;
             break;
         }
         
@@ -365,7 +917,7 @@ float FidgetAudioProcessor::processWeirdOscillator(float baseValue, int noteNumb
     return output;
 }
 
-float FidgetAudioProcessor::processChaosFilter(float input, FilterType type, float cutoff, float resonance)
+float FidgetAudioProcessor::Voice::processChaosFilter(float input, FilterType type, float cutoff, float resonance)
 {
     // Normalize cutoff to 0-1 range
     float normalizedCutoff = juce::jlimit(0.0f, 1.0f, cutoff / static_cast<float>(currentSampleRate * 0.5));
@@ -475,16 +1027,17 @@ float FidgetAudioProcessor::processChaosFilter(float input, FilterType type, flo
         
         case FilterType::Phaser:
         {
-            // 4-stage phaser
-            phaserPhase += 0.5f / static_cast<float>(currentSampleRate);
-            if (phaserPhase > 1.0f) phaserPhase -= 1.0f;
+            // 4-stage phaser, fewer stages at lower quality tiers
+            phaserPhase += 0.5 / currentSampleRate;
+            if (phaserPhase > 1.0) phaserPhase -= 1.0;
             
-            float lfo = std::sin(phaserPhase * 2.0f * juce::MathConstants<float>::pi);
+            float lfo = std::sin(static_cast<float>(phaserPhase) * 2.0f * juce::MathConstants<float>::pi);
             float sweepFreq = cutoff * (1.0f + lfo * 0.5f);
             float allpassFreq = sweepFreq / static_cast<float>(currentSampleRate);
             
+            const int numStages = quality == QualityTier::Full ? 4 : (quality == QualityTier::Reduced ? 2 : 1);
             float signal = input;
-            for (int i = 0; i < 4; ++i)
+            for (int i = 0; i < numStages; ++i)
             {
                 float temp = signal;
                 signal = phaserStages[i] + signal * allpassFreq;
@@ -512,76 +1065,325 @@ float FidgetAudioProcessor::processChaosFilter(float input, FilterType type, flo
 }
 
 void FidgetAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    process(buffer, midiMessages);
+}
+
+void FidgetAudioProcessor::processBlock (juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
+{
+    process(buffer, midiMessages);
+}
+
+template <typename SampleType>
+void FidgetAudioProcessor::process(juce::AudioBuffer<SampleType>& buffer, juce::MidiBuffer& midiMessages)
 {
     juce::ScopedNoDenormals noDenormals;
-    auto totalNumInputChannels  = getTotalNumInputChannels();
-    auto totalNumOutputChannels = getTotalNumOutputChannels();
+    TraceRecorder::ScopedEvent blockEvent(trace, "processBlock", getTraceInfo(currentNote));
+    
+    const auto startTicks = juce::Time::getHighResolutionTicks();
+    const bool reseed = seedPending.exchange(false);
+    for (auto& voice : voices)
+    {
+        voice.quality = getCurrentQualityTier();
+        if (reseed)
+            voice.random.setSeed(noiseSeed);
+    }
+    renderBlock(buffer, midiMessages);
+    updateQualityGovernor(juce::Time::getHighResolutionTicks() - startTicks, buffer.getNumSamples());
+}
 
-    for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
-        buffer.clear (i, 0, buffer.getNumSamples());
+void FidgetAudioProcessor::updateQualityGovernor(juce::int64 elapsedTicks, int numSamples)
+{
+    // Offline renders must not depend on how long a block took
+    if (isNonRealtime() || ! parameterCache.autoQuality || numSamples <= 0)
+    {
+        qualityTier = static_cast<int>(QualityTier::Full);
+        smoothedLoad = 0.0f;
+        samplesSinceTierChange = 0;
+        headroomSamples = 0;
+        return;
+    }
+    
+    const float stepDownLoad = 0.6f;    // fraction of the block's real-time budget
+    const float stepUpLoad = 0.25f;
+    const int minSamplesBetweenSteps = static_cast<int>(0.1 * currentSampleRate);
+    const int headroomToStepUp = static_cast<int>(1.0 * currentSampleRate);
+    
+    const double budget = numSamples / currentSampleRate;
+    const float load = static_cast<float>(juce::Time::highResolutionTicksToSeconds(elapsedTicks) / budget);
+    
+    // Follow spikes quickly, recover slowly
+    smoothedLoad += (load - smoothedLoad) * (load > smoothedLoad ? 0.5f : 0.05f);
+    samplesSinceTierChange += numSamples;
+    headroomSamples = smoothedLoad < stepUpLoad ? headroomSamples + numSamples : 0;
+    
+    int tier = qualityTier.load();
+    const int lowestTier = static_cast<int>(QualityTier::NUM_QUALITY_TIERS) - 1;
+    
+    if (smoothedLoad > stepDownLoad && tier < lowestTier && samplesSinceTierChange >= minSamplesBetweenSteps)
+    {
+        qualityTier = ++tier;
+        samplesSinceTierChange = 0;
+        trace.instant("qualityDown");
+    }
+    else if (headroomSamples >= headroomToStepUp && tier > 0)
+    {
+        qualityTier = --tier;
+        samplesSinceTierChange = 0;
+        headroomSamples = 0;
+        trace.instant("qualityUp");
+    }
+}
+
+void FidgetAudioProcessor::updateParameterCache(int numSamples)
+{
+    const float weirdness = *weirdnessParam;
+    
+    // The host's new value is reached at the end of the block, ramping from where the last one ended
+    if (! parameterCache.valid)
+        parameterCache.weirdness = weirdness;
+    parameterCache.weirdnessStep = numSamples > 0 ? (weirdness - parameterCache.weirdness) / numSamples : 0.0f;
+    parameterCache.noteCache = *noteCacheParam > 0.5f;
+    parameterCache.autoQuality = *autoQualityParam > 0.5f;
+    parameterCache.valid = true;
+}
 
-    // Process MIDI messages
-    for (const auto metadata : midiMessages)
+int FidgetAudioProcessor::getKnobPosition() const
+{
+    // Convert weirdness to knob position (0-127)
+    return juce::jlimit(0, 127, static_cast<int>(parameterCache.weirdness * 127.0f));
+}
+
+void FidgetAudioProcessor::handleMidiMessage(const juce::MidiMessage& message)
+{
+    if (message.isNoteOn())
     {
-        auto message = metadata.getMessage();
+        // Keys the tuning leaves unmapped do not sound
+        const auto& pitch = pitchTable.getActive().notes[message.getNoteNumber()];
+        if (pitch.frequency <= 0.0f)
+            return;
+        
+        // Mono synth: a new note while one is held takes over its voice
+        if (noteOn && currentNote != message.getNoteNumber())
+            trace.instant("voiceSteal", getTraceInfo(currentNote));
+        trace.instant("noteOn", getTraceInfo(message.getNoteNumber()));
+        
+        currentNote = message.getNoteNumber();
+        velocity = message.getFloatVelocity();
+        noteOn = true;
         
-        if (message.isNoteOn())
+        // Reset oscillator states for consistent sound
+        for (auto& voice : voices)
+            voice.startNote(pitch);
+        modState.noteOn();
+        
+        // Deterministic notes play from memory when they have been rendered already;
+        // modulated ones depend on more than the knob, and the effect's on its input
+        stopCachedNote();
+        if (! isAudioEffect && parameterCache.noteCache && ! modMatrix.getActive().isActive()
+            && isNoteCacheable(noteWeirdness.getActive()[currentNote]))
+            startCachedNote(getKnobPosition());
+    }
+    else if (message.isNoteOff())
+    {
+        if (message.getNoteNumber() == currentNote)
         {
-            currentNote = message.getNoteNumber();
-            velocity = message.getFloatVelocity();
-            frequency = midiNoteToFrequency(currentNote);
-            noteOn = true;
-            
-            // Reset oscillator states for consistent sound
-            phase = 0.0f;
-            phase2 = 0.0f;
-            subPhase = 0.0f;
-            fmPhase = 0.0f;
-            wobblePhase = 0.0f;
-            grainPhase = 0.0f;
-            glitchCounter = 0;
-            filterState = 0.0f;
-            
-            // Reset supersaw phases with slight detuning
-            for (int i = 0; i < 7; ++i)
-            {
-                sawPhases[i] = 0.0f;
-            }
-            
-            // Reset filter states
-            filterState1 = 0.0f;
-            filterState2 = 0.0f;
-            filterState3 = 0.0f;
-            filterState4 = 0.0f;
-            phaserPhase = 0.0f;
-            for (int i = 0; i < 4; ++i)
-            {
-                phaserStages[i] = 0.0f;
-            }
+            noteOn = false;
+            trace.instant("noteOff", getTraceInfo(currentNote));
         }
-        else if (message.isNoteOff())
+    }
+}
+
+template <typename SampleType>
+void FidgetAudioProcessor::renderBlock(juce::AudioBuffer<SampleType>& buffer, juce::MidiBuffer& midiMessages)
+{
+    auto totalNumInputChannels  = getTotalNumInputChannels();
+    auto totalNumOutputChannels = getTotalNumOutputChannels();
+    const int numSamples = buffer.getNumSamples();
+
+    for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
+        buffer.clear (i, 0, numSamples);
+    
+    updateParameterCache(numSamples);
+    updatePitchTable();
+    modMatrix.update();
+    
+    // Split the block at every MIDI event, and at least every maxSegmentSize samples
+    // so weirdness ramps are followed at the same rate whatever the host's buffer size
+    auto midiIterator = midiMessages.begin();
+    const auto midiEnd = midiMessages.end();
+    int position = 0;
+    
+    for (;;)
+    {
+        auto isDue = [&] { return (*midiIterator).samplePosition <= position || position >= numSamples; };
+        if (midiIterator != midiEnd && isDue())
         {
-            if (message.getNoteNumber() == currentNote)
-            {
-                noteOn = false;
-            }
+            trace.begin("midi");
+            for (; midiIterator != midiEnd && isDue(); ++midiIterator)
+                handleMidiMessage((*midiIterator).getMessage());
+            trace.end("midi");
         }
+        
+        if (position >= numSamples)
+            break;
+        
+        int segmentEnd = juce::jmin(numSamples, position + maxSegmentSize);
+        if (midiIterator != midiEnd)
+            segmentEnd = juce::jmin(segmentEnd, (*midiIterator).samplePosition);
+        
+        renderSegment(buffer, position, segmentEnd - position);
+        position = segmentEnd;
+    }
+    
+    // The voice was rendered once into the first channel of its output; copy it to the others.
+    // The effect build processed every channel itself.
+    for (int busIndex = isAudioEffect ? getBusCount(false) : 0; busIndex < getBusCount(false); ++busIndex)
+    {
+        auto bus = getBusBuffer(buffer, false, busIndex);
+        for (int channel = 1; channel < bus.getNumChannels(); ++channel)
+            bus.copyFrom (channel, 0, bus, 0, 0, numSamples);
+    }
+}
+
+void FidgetAudioProcessor::updateNoteMapping()
+{
+    // A new mapping waits for the old one to fade out, then restarts the held note under it
+    const bool sounding = currentNote >= 0 && envelope > 0.0f;
+    
+    if (! sounding)
+    {
+        // Nothing to hide, so a pending mapping is taken at once, and a fade the note's end cut
+        // short is finished. The effect build's passthrough never advances the fade, which would
+        // otherwise leave it for the next note to start with.
+        programGain = 1.0f;
+        programGainStep = 0.0f;
+        if (! noteWeirdness.hasPending())
+            return;
+    }
+    else if (programGainStep == 0.0f && noteWeirdness.hasPending())
+    {
+        programGainStep = -1.0f / programFadeLength;
+        return;
+    }
+    else if (programGainStep < 0.0f && programGain <= 0.0f)
+    {
+        programGainStep = 1.0f / programFadeLength;
+    }
+    else
+    {
+        if (programGainStep > 0.0f && programGain >= 1.0f)
+            programGainStep = 0.0f;
+        return;
+    }
+    
+    noteWeirdness.update();
+    stopCachedNote();
+    if (sounding)
+        for (auto& voice : voices)
+            voice.startNote(pitchTable.getActive().notes[currentNote]);
+    trace.instant("programSwitch", getTraceInfo(currentNote));
+}
+
+// Copies the note's per-note amounts and types, moved by the segment's modulation
+static void modulateNoteWeirdness(const FidgetAudioProcessor::NoteWeirdness& note, const ModMatrix::State& state,
+                                  FidgetAudioProcessor::NoteWeirdness& modulated)
+{
+    using Destination = ModMatrix::Destination;
+    auto modulate = [&state](Destination destination, float value)
+    {
+        return ModMatrix::modulate(destination, value, state.getOffset(destination));
+    };
+    
+    modulated.type = note.type;
+    modulated.waveType = note.waveType;
+    modulated.filterType = note.filterType;
+    modulated.bitDepth = note.bitDepth;
+    modulated.wobbleRate = modulate(Destination::WobbleRate, note.wobbleRate);
+    modulated.glitchChance = modulate(Destination::GlitchChance, note.glitchChance);
+    modulated.harmonicMix = modulate(Destination::HarmonicMix, note.harmonicMix);
+    modulated.ringModFreq = modulate(Destination::RingModFreq, note.ringModFreq);
+    modulated.filterFreq = modulate(Destination::FilterFreq, note.filterFreq);
+    modulated.grainSize = modulate(Destination::GrainSize, note.grainSize);
+}
+
+template <typename SampleType>
+void FidgetAudioProcessor::renderSegment(juce::AudioBuffer<SampleType>& buffer, int startSample, int numSamples)
+{
+    const float weirdness = parameterCache.weirdness;
+    int knobPosition = getKnobPosition();
+    parameterCache.weirdness += parameterCache.weirdnessStep * numSamples;
+    updateNoteMapping();
+    
+    if (buffer.getNumChannels() == 0)
+        return;
+    
+    // Nothing has been played yet. The effect build passes its input through until a note
+    // is held, and again once the note has been released.
+    if (currentNote < 0 || (isAudioEffect && ! noteOn && envelope <= 0.0f))
+    {
+        if (! isAudioEffect)
+            buffer.clear(0, startSample, numSamples);
+        return;
     }
     
-    // Get current weirdness value and convert to knob position (0-127)
-    float weirdnessValue = *weirdnessParam;
-    int knobPosition = static_cast<int>(weirdnessValue * 127.0f);
+    auto& voice = voices[0];
+    
+    // Control-rate routes are summed once here; only audio-rate ones are followed per sample
+    const auto& matrix = modMatrix.getActive();
+    const bool modulating = matrix.isActive();
+    const bool audioRateModulation = modulating && matrix.hasAudioRoutes();
+    if (modulating)
+    {
+        modState.beginSegment(matrix, envelope, velocity, currentNote, numSamples);
+        const float modulatedWeirdness = ModMatrix::modulate(ModMatrix::Destination::Weirdness, weirdness,
+                                                             modState.getOffset(ModMatrix::Destination::Weirdness));
+        knobPosition = juce::jlimit(0, 127, static_cast<int>(modulatedWeirdness * 127.0f));
+    }
+    
+    // A frozen note is only valid for the knob position and tuning it was rendered at, unmodulated
+    if (cachedSamples != nullptr && liveFadeRemaining == 0
+        && (knobPosition != cachedKnobPosition || cachedTuning != pitchTable.getActiveGeneration() || ! parameterCache.noteCache || modulating))
+    {
+        // The live voice takes over where the frozen one is. Oscillators and LFOs are moved there
+        // directly; filter and weird-stage state are built up by running it silently for a moment
+        // at the frozen note's settings, so glitch and grain buffers only hold that moment.
+        const auto& frozen = noteWeirdness.getActive()[currentNote];
+        const int warmUp = juce::jmin(cachedElapsed, liveWarmUpLength);
+        voice.syncOscillators(frozen, cachedElapsed - warmUp);
+        for (int i = 0; i < warmUp; ++i)
+            voice.renderSample(frozen, frozen.randomAmounts[cachedKnobPosition], frozen.randomCutoffs[cachedKnobPosition],
+                               frozen.randomResonances[cachedKnobPosition]);
+        liveFadeRemaining = liveFadeLength;
+    }
     
     // Get the random amount for this knob position
-    float randomWeirdnessAmount = 0.0f;
-    float randomCutoff = 1000.0f;
-    float randomResonance = 0.0f;
-    if (currentNote >= 0 && currentNote < 128)
+    const auto& note = noteWeirdness.getActive()[currentNote];
+    float randomWeirdnessAmount = note.randomAmounts[knobPosition];
+    float randomCutoff = note.randomCutoffs[knobPosition];
+    float randomResonance = note.randomResonances[knobPosition];
+    
+    if (modulating)
     {
-        randomWeirdnessAmount = noteWeirdness[currentNote].randomAmounts[knobPosition];
-        randomCutoff = noteWeirdness[currentNote].randomCutoffs[knobPosition];
-        randomResonance = noteWeirdness[currentNote].randomResonances[knobPosition];
+        modulateNoteWeirdness(note, modState, modulatedNote);
+        if (! audioRateModulation)
+        {
+            randomWeirdnessAmount = ModMatrix::modulate(ModMatrix::Destination::Amount, randomWeirdnessAmount, modState.getOffset(ModMatrix::Destination::Amount));
+            randomCutoff = ModMatrix::modulate(ModMatrix::Destination::Cutoff, randomCutoff, modState.getOffset(ModMatrix::Destination::Cutoff));
+            randomResonance = ModMatrix::modulate(ModMatrix::Destination::Resonance, randomResonance, modState.getOffset(ModMatrix::Destination::Resonance));
+        }
     }
+    const auto& nw = modulating ? modulatedNote : note;
+    
+    // Rendered straight into the first channel of the note's output
+    const int channel = weirdTypeChannels[static_cast<size_t>(nw.type)];
+    SampleType* channelData = buffer.getWritePointer(channel < buffer.getNumChannels() ? channel : 0);
+    
+    // The effect build processes the host's input channels in place, one voice each
+    std::array<SampleType*, numVoices> inputData {};
+    const int numInputChannels = isAudioEffect ? juce::jmin(numVoices, buffer.getNumChannels(), getTotalNumInputChannels()) : 0;
+    for (int i = 0; i < numInputChannels; ++i)
+        inputData[static_cast<size_t>(i)] = buffer.getWritePointer(i);
     
     // Calculate envelope
     float envelopeIncrement = 0.0f;
@@ -594,82 +1396,262 @@ void FidgetAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce:
         envelopeIncrement = -1.0f / (releaseTime * currentSampleRate);
     }
     
-    // Generate audio
-    const float phaseIncrement = frequency / currentSampleRate;
-    const float subPhaseIncrement = (frequency * 0.5f) / currentSampleRate; // Sub osc at half frequency
-    const float fmPhaseIncrement = (frequency * 2.0f) / currentSampleRate; // FM at double frequency
-    
-    // Get wave type and filter type for current note
-    WaveType waveType = currentNote >= 0 ? noteWeirdness[currentNote].waveType : WaveType::Sine;
-    FilterType filterType = currentNote >= 0 ? noteWeirdness[currentNote].filterType : FilterType::LowPass;
+    TraceRecorder::ScopedEvent renderEvent(trace, "render", getTraceInfo(currentNote));
     
-    for (int channel = 0; channel < totalNumOutputChannels; ++channel)
+    for (int sample = startSample; sample < startSample + numSamples; ++sample)
     {
-        auto* channelData = buffer.getWritePointer (channel);
-
-        for (int sample = 0; sample < buffer.getNumSamples(); ++sample)
+        // Update envelope
+        envelope = juce::jlimit(0.0f, 1.0f, envelope + envelopeIncrement);
+        programGain = juce::jlimit(0.0f, 1.0f, programGain + programGainStep);
+        
+        float amount = randomWeirdnessAmount;
+        float cutoff = randomCutoff;
+        float resonance = randomResonance;
+        if (audioRateModulation)
+            modState.applyAudioRate(matrix, amount, cutoff, resonance);
+        
+        if constexpr (isAudioEffect)
         {
-            // Update envelope
-            envelope = juce::jlimit(0.0f, 1.0f, envelope + envelopeIncrement);
-            
-            // Generate oscillator based on wave type
-            float waveform = generateOscillator(waveType, phase, frequency);
-            
-            // Apply weird processing with random amount
-            float weirdWave = processWeirdOscillator(waveform, currentNote, randomWeirdnessAmount);
-            
-            // Apply chaos filter
-            float filtered = processChaosFilter(weirdWave, filterType, randomCutoff, randomResonance);
-            
-            // Output with envelope and velocity
-            channelData[sample] = amplitude * envelope * velocity * filtered;
-            
-            // Update phases
-            phase += phaseIncrement;
-            if (phase > 1.0f) phase -= 1.0f;
-            
-            subPhase += subPhaseIncrement;
-            if (subPhase > 1.0f) subPhase -= 1.0f;
-            
-            fmPhase += fmPhaseIncrement;
-            if (fmPhase > 1.0f) fmPhase -= 1.0f;
+            // Crossfades from the dry input to the processed one as the note's envelope opens;
+            // the dry share keeps the host's precision
+            const auto wet = static_cast<SampleType>(envelope * programGain);
+            // Each channel runs through its own voice, as the weird stage is nonlinear and a
+            // shared one would leak one side's processing into the other
+            for (int i = 0; i < numInputChannels; ++i)
+            {
+                SampleType* data = inputData[static_cast<size_t>(i)];
+                const SampleType input = data[sample];
+                const auto processed = voices[static_cast<size_t>(i)].processSample(static_cast<float>(input), nw, amount, cutoff, resonance);
+                data[sample] = input + (static_cast<SampleType>(processed) - input) * wet;
+            }
+            continue;
+        }
+        
+        float filtered;
+        if (cachedSamples != nullptr)
+        {
+            filtered = cachedSamples[cachedPosition];
+            if (++cachedPosition >= cachedLength) cachedPosition = cachedLoopStart;
+            ++cachedElapsed;
             
-            // Update supersaw phases
-            for (int i = 0; i < 7; ++i)
+            if (liveFadeRemaining > 0)
             {
-                float detune = 1.0f + (i - 3) * 0.01f;
-                sawPhases[i] += (phaseIncrement * detune);
-                if (sawPhases[i] > 1.0f) sawPhases[i] -= 1.0f;
+                float live = voice.renderSample(nw, amount, cutoff, resonance);
+                float fade = 1.0f - static_cast<float>(liveFadeRemaining) / liveFadeLength;
+                filtered += (live - filtered) * fade;
+                if (--liveFadeRemaining == 0)
+                    stopCachedNote();
             }
         }
+        else
+        {
+            filtered = voice.renderSample(nw, amount, cutoff, resonance);
+        }
+        
+        // Output with envelope and velocity
+        channelData[sample] = static_cast<SampleType>(amplitude * envelope * velocity * programGain * filtered);
     }
 }
 
+// Headless builds (the command-line tools) leave the editor out
 bool FidgetAudioProcessor::hasEditor() const
 {
+   #if FIDGET_HEADLESS
+    return false;
+   #else
     return true;
+   #endif
 }
 
 juce::AudioProcessorEditor* FidgetAudioProcessor::createEditor()
 {
+   #if FIDGET_HEADLESS
+    return nullptr;
+   #else
     return new FidgetAudioProcessorEditor (*this);
+   #endif
 }
 
+// Binary state chunk: magic, version, then the parameters by ID, the noise seed, the
+// program and its name list (version 2), the personality map if there is one, with
+// the file it came from (version 3; versions 1-2 stored types and amounts only), the
+// Scala tuning's sources if it is not 12-TET (version 4), and the modulation matrix as
+// JSON if it has any routes (version 5).
+// Bump stateVersion when changing the layout, and keep reading the older ones.
+static constexpr int stateMagic = 0x53474446; // "FDGS"
+static constexpr int stateVersion = 5;
+
 void FidgetAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    auto state = parameters.copyState();
-    std::unique_ptr<juce::XmlElement> xml(state.createXml());
-    copyXmlToBinary(*xml, destData);
+    juce::MemoryOutputStream out(destData, false);
+    writeBinaryState(out);
 }
 
 void FidgetAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
+    juce::MemoryInputStream in(data, static_cast<size_t>(sizeInBytes), false);
+    if (sizeInBytes >= 8 && in.readInt() == stateMagic)
+    {
+        readBinaryState(in);
+        return;
+    }
+    
+    // Sessions saved before the binary format hold the parameter tree as XML
     std::unique_ptr<juce::XmlElement> xmlState(getXmlFromBinary(data, sizeInBytes));
     if (xmlState.get() != nullptr)
         if (xmlState->hasTagName(parameters.state.getType()))
             parameters.replaceState(juce::ValueTree::fromXml(*xmlState));
 }
 
+void FidgetAudioProcessor::writeBinaryState(juce::OutputStream& out)
+{
+    out.writeInt(stateMagic);
+    out.writeInt(stateVersion);
+    
+    // Our getParameters() returns the APVTS, so ask the base class
+    const auto& params = AudioProcessor::getParameters();
+    out.writeInt(params.size());
+    for (auto* param : params)
+    {
+        auto* ranged = dynamic_cast<juce::RangedAudioParameter*>(param);
+        out.writeString(ranged != nullptr ? ranged->paramID : juce::String());
+        out.writeFloat(ranged != nullptr ? ranged->convertFrom0to1(ranged->getValue()) : 0.0f);
+    }
+    
+    out.writeInt64(noiseSeed);
+    
+    out.writeInt(programs.getCurrentProgram());
+    out.writeInt(programs.getNumPrograms());
+    for (int i = 0; i < programs.getNumPrograms(); ++i)
+        out.writeString(programs.getProgram(i).name);
+    
+    {
+        const juce::ScopedLock sl(mappingLock);
+        out.writeBool(personalityMap != nullptr);
+        if (personalityMap != nullptr)
+            personalityMap->writeBinary(out);
+        out.writeString(personalityMapFile.getFullPathName());
+    }
+    
+    {
+        const juce::ScopedLock sl(tuningLock);
+        out.writeBool(! tuning->isDefault());
+        if (! tuning->isDefault())
+        {
+            out.writeString(tuning->getScaleText());
+            out.writeString(tuning->getKeyboardMappingText());
+        }
+    }
+    
+    const juce::ScopedLock sl(modulationLock);
+    out.writeBool(! modulation->isEmpty());
+    if (! modulation->isEmpty())
+        out.writeString(modulation->toJson());
+}
+
+bool FidgetAudioProcessor::readBinaryState(juce::InputStream& in)
+{
+    const int version = in.readInt();
+    if (version < 1 || version > stateVersion)
+        return false;
+    
+    const int numParams = in.readInt();
+    for (int i = 0; i < numParams && ! in.isExhausted(); ++i)
+    {
+        auto paramID = in.readString();
+        auto value = in.readFloat();
+        if (auto* param = parameters.getParameter(paramID))
+            param->setValueNotifyingHost(param->convertTo0to1(value));
+    }
+    
+    if (in.getNumBytesRemaining() < 9)
+        return false;
+    
+    setRandomSeed(in.readInt64());
+    
+    // Sessions from before the program bank are on the first program
+    int program = 0;
+    if (version >= 2)
+    {
+        program = in.readInt();
+        const int numNames = in.readInt();
+        for (int i = 0; i < numNames && ! in.isExhausted(); ++i)
+            programs.setProgramName(i, in.readString());
+    }
+    
+    std::shared_ptr<PersonalityMap> map;
+    if (in.readBool())
+    {
+        map = std::make_shared<PersonalityMap>();
+        if (version >= 3)
+        {
+            if (in.readInt() != PersonalityMap::binaryMagic || map->readBinary(in).failed())
+                return false;
+        }
+        else
+        {
+            // Types and per-note amounts only, spread over the default ranges
+            const int bytesPerNote = 3 + 7 * static_cast<int>(sizeof(float));
+            if (in.getNumBytesRemaining() < 128 * bytesPerNote)
+                return false;
+            
+            for (auto& note : map->notes)
+            {
+                auto type = static_cast<juce::uint8>(in.readByte());
+                auto waveType = static_cast<juce::uint8>(in.readByte());
+                auto filterType = static_cast<juce::uint8>(in.readByte());
+                note.type = static_cast<WeirdType>(juce::jmin<int>(type, static_cast<int>(WeirdType::NUM_TYPES) - 1));
+                note.waveType = static_cast<WaveType>(juce::jmin<int>(waveType, static_cast<int>(WaveType::NUM_WAVE_TYPES) - 1));
+                note.filterType = static_cast<FilterType>(juce::jmin<int>(filterType, static_cast<int>(FilterType::NUM_FILTER_TYPES) - 1));
+                note.wobbleRate = in.readFloat();
+                note.glitchChance = in.readFloat();
+                note.harmonicMix = in.readFloat();
+                note.ringModFreq = in.readFloat();
+                note.filterFreq = in.readFloat();
+                note.bitDepth = in.readFloat();
+                note.grainSize = in.readFloat();
+            }
+        }
+    }
+    
+    // The saved map is used as is; the file is only watched for further edits
+    juce::File mapFile;
+    if (version >= 3)
+    {
+        auto path = in.readString();
+        if (map != nullptr && juce::File::isAbsolutePath(path))
+            mapFile = juce::File(path);
+    }
+    
+    setPersonalityMap(std::move(map), mapFile);
+    
+    // The tuning is rebuilt from its sources, so the session does not need the .scl file
+    auto newTuning = std::make_shared<Tuning>();
+    if (version >= 4 && in.readBool())
+    {
+        auto scaleText = in.readString();
+        auto keyboardMappingText = in.readString();
+        if (newTuning->parse(scaleText, keyboardMappingText).failed())
+            newTuning = std::make_shared<Tuning>();
+    }
+    
+    {
+        const juce::ScopedLock sl(tuningLock);
+        publishPitchTable(std::move(newTuning), pitchTableSampleRate);
+    }
+    
+    // Settings that no longer parse fall back to no modulation rather than failing the session
+    ModMatrix::Settings newModulation;
+    if (version >= 5 && in.readBool() && newModulation.parseJson(in.readString()).failed())
+        newModulation = {};
+    setModulation(newModulation);
+    
+    // Built by the program loader and faded in like any other program switch
+    if (! programs.select(program))
+        programs.select(0);
+    return true;
+}
+
 juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
 {
     return new FidgetAudioProcessor();
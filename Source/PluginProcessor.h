@@ -1,8 +1,20 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "TraceRecorder.h"
+#include "RcuPublisher.h"
+#include "ProgramBank.h"
+#include "Tuning.h"
+#include "GranularEngine.h"
+#include "GlitchEngine.h"
+#include "ModMatrix.h"
 
-class FidgetAudioProcessor : public juce::AudioProcessor
+class NoteCache;
+struct PersonalityMap;
+
+class FidgetAudioProcessor : public juce::AudioProcessor,
+                             private juce::Timer,
+                             private juce::AsyncUpdater
 {
 public:
     FidgetAudioProcessor();
@@ -10,12 +22,16 @@ public:
 
     void prepareToPlay (double sampleRate, int samplesPerBlock) override;
     void releaseResources() override;
+    void reset() override;
 
    #ifndef JucePlugin_PreferredChannelConfigurations
     bool isBusesLayoutSupported (const BusesLayout& layouts) const override;
    #endif
 
+    // Hosts with a 64-bit mix engine get the double version, without converting buffers
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void processBlock (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
+    bool supportsDoublePrecisionProcessing() const override { return true; }
 
     juce::AudioProcessorEditor* createEditor() override;
     bool hasEditor() const override;
@@ -40,6 +56,37 @@ public:
     int getCurrentNote() const { return currentNote; }
     juce::AudioProcessorValueTreeState& getParameters() { return parameters; }
     
+    // Audio-thread timeline capture (Chrome trace JSON), also enabled by FIDGET_TRACE_FILE
+    bool startTracing(const juce::File& file) { return trace.start(file); }
+    void stopTracing() { trace.stop(); }
+    
+    // Fixes the noise generators so offline renders are repeatable (saved with the state). The
+    // audio thread owns the generators, so they are reseeded at the start of the next block.
+    void setRandomSeed(juce::int64 seed) { noiseSeed = seed; seedPending = true; }
+    
+    // Frozen-voice playback: deterministic notes are pre-rendered in the background
+    // and played from memory until the knob moves (see NoteCache)
+    void setNoteCacheMemoryLimit(size_t bytes);
+    
+    // Note personality maps (JSON or binary, see PersonalityMap). The file is watched and
+    // reloaded whenever it changes, until another program is picked or the map is cleared.
+    juce::Result loadPersonalityMap(const juce::File& file);
+    juce::Result savePersonalityMap(const juce::File& file) const; // compact binary form of the current map
+    void clearPersonalityMap();
+    juce::File getPersonalityMapFile() const;
+    juce::String getPersonalityMapError() const; // why the last reload failed, if it did
+    
+    // Scala microtuning. A held note is retuned in place; keys the mapping leaves out are silent.
+    juce::Result loadTuning(const juce::File& scale, const juce::File& keyboardMapping = {});
+    void resetTuning(); // back to 12-TET
+    juce::String getTuningName() const;
+    
+    // Modulation matrix routes (see ModMatrix). Compiled off the audio thread; an empty
+    // matrix leaves the sound exactly as it was without one.
+    void setModulation(const ModMatrix::Settings& settings);
+    juce::Result loadModulation(const juce::File& file); // JSON
+    ModMatrix::Settings getModulation() const;
+    
     // Weird behavior types
     enum class WeirdType
     {
@@ -54,7 +101,7 @@ public:
         NUM_TYPES
     };
     
-    const char* getWeirdTypeName(WeirdType type) const
+    static const char* getWeirdTypeName(WeirdType type)
     {
         switch(type)
         {
@@ -90,7 +137,7 @@ public:
         NUM_WAVE_TYPES
     };
     
-    const char* getWaveTypeName(WaveType type) const
+    static const char* getWaveTypeName(WaveType type)
     {
         switch(type)
         {
@@ -130,7 +177,7 @@ public:
         NUM_FILTER_TYPES
     };
     
-    const char* getFilterTypeName(FilterType type) const
+    static const char* getFilterTypeName(FilterType type)
     {
         switch(type)
         {
@@ -151,54 +198,32 @@ public:
     }
     
     FilterType getCurrentFilterType() const;
-
-private:
-    // Parameters
-    juce::AudioProcessorValueTreeState parameters;
-    std::atomic<float>* weirdnessParam = nullptr;
     
-    double currentSampleRate = 44100.0;
-    float phase = 0.0f;
-    float frequency = 440.0f;
-    float amplitude = 0.1f;
+    // Quality tiers the CPU governor steps through when a block gets close to its deadline
+    enum class QualityTier
+    {
+        Full,           // 7 supersaw voices, 4 phaser stages, 256 grains
+        Reduced,        // 3 supersaw voices, 2 phaser stages, 64 grains
+        Minimal,        // 1 saw, 1 phaser stage, 16 grains, approximated sines
+        NUM_QUALITY_TIERS
+    };
     
-    // MIDI handling
-    int currentNote = -1;  // -1 means no note playing
-    float velocity = 0.0f;
+    static const char* getQualityTierName(QualityTier tier)
+    {
+        switch(tier)
+        {
+            case QualityTier::Full: return "Full";
+            case QualityTier::Reduced: return "Reduced";
+            case QualityTier::Minimal: return "Minimal";
+            default: return "Unknown";
+        }
+    }
     
-    // Simple envelope
-    float envelope = 0.0f;
-    float attackTime = 0.01f;  // 10ms attack
-    float releaseTime = 0.1f;  // 100ms release
-    bool noteOn = false;
+    QualityTier getCurrentQualityTier() const { return static_cast<QualityTier>(qualityTier.load()); }
     
-    // Weird synthesis state
-    float phase2 = 0.0f;      // Secondary oscillator
-    float filterState = 0.0f; // For filter sweep
-    float bitCrushHold = 0.0f; // For bit crusher
-    int glitchCounter = 0;    // For glitcher
-    float wobblePhase = 0.0f; // For wobbler LFO
-    float grainPhase = 0.0f;  // For granular
-    
-    // Additional oscillator state
-    float subPhase = 0.0f;    // For sub oscillator
-    float fmPhase = 0.0f;     // For FM carrier
-    float noiseState = 0.0f;  // For pink noise
-    float crackleTimer = 0.0f; // For crackle noise
-    std::array<float, 7> sawPhases = {0}; // For supersaw
-    
-    // Random number generator for consistent randomness
-    juce::Random random;
-    
-    // Filter state variables
-    float filterState1 = 0.0f;
-    float filterState2 = 0.0f;
-    float filterState3 = 0.0f;
-    float filterState4 = 0.0f;
-    float combDelay[44100] = {0}; // 1 second of delay for comb filter
-    int combIndex = 0;
-    float phaserPhase = 0.0f;
-    std::array<float, 4> phaserStages = {0};
+    // The effect build (FidgetFX) runs its input through the weird and chaos-filter stages
+    // in place, with the held note choosing the personality, instead of playing a note
+    static constexpr bool isAudioEffect = ! JucePlugin_IsSynth;
     
     // Per-note deterministic weirdness
     struct NoteWeirdness
@@ -221,30 +246,247 @@ private:
         std::array<float, 128> randomResonances = {0};
     };
     
-    std::array<NoteWeirdness, 128> noteWeirdness;
+    using NoteWeirdnessTable = std::array<NoteWeirdness, 128>;
     
-    // Helper functions
-    float midiNoteToFrequency(int midiNote)
+    // Pitch of one note at one sample rate, so note-on is a lookup
+    struct NotePitch
     {
-        return 440.0f * std::pow(2.0f, (midiNote - 69) / 12.0f);
-    }
+        float frequency = 0.0f;       // 0 for keys the tuning leaves unmapped
+        double phaseIncrement = 0.0;
+        double subPhaseIncrement = 0.0;
+        double fmPhaseIncrement = 0.0;
+    };
+    
+    struct PitchTable
+    {
+        double sampleRate = 44100.0;
+        std::array<NotePitch, 128> notes;
+    };
+    
+    static std::shared_ptr<const PitchTable> createPitchTable(const Tuning& tuning, double sampleRate);
+    
+    // Oscillator, weird and filter state of the sounding note. Everything before
+    // the envelope lives here, so the note cache can render notes with its own copy.
+    // Samples are computed in float; the phases run in double, so long held notes
+    // neither drift nor pick up jitter as float rounding would give them.
+    struct Voice
+    {
+        void prepare(double sampleRate);
+        void startNote(const NotePitch& pitch);
+        void setPitch(const NotePitch& pitch); // keeps the oscillators running
+        void reset();
+        
+        // Next pre-envelope sample of the note described by nw
+        float renderSample(const NoteWeirdness& nw, float weirdnessAmount, float cutoff, float resonance);
+        
+        // The same, with input in place of the oscillator
+        float processSample(float input, const NoteWeirdness& nw, float weirdnessAmount, float cutoff, float resonance);
+        
+        // Moves the pitch oscillators, and the LFOs of nw's weird type and filter, to where they
+        // would be after the given number of samples of the note
+        void syncOscillators(const NoteWeirdness& nw, int samplesSinceNoteOn);
+        
+        double currentSampleRate = 44100.0;
+        QualityTier quality = QualityTier::Full;
+        double phase = 0.0;
+        float frequency = 440.0f;
+        double phaseIncrement = 0.0;
+        double subPhaseIncrement = 0.0;
+        double fmPhaseIncrement = 0.0;
+        
+        // Weird synthesis state
+        double phase2 = 0.0;      // Secondary oscillator
+        float filterState = 0.0f; // For filter sweep
+        float bitCrushHold = 0.0f; // For bit crusher
+        double wobblePhase = 0.0; // For wobbler LFO
+        
+        // Additional oscillator state
+        double subPhase = 0.0;    // For sub oscillator
+        double fmPhase = 0.0;     // For FM carrier
+        float noiseState = 0.0f;  // For pink noise
+        float crackleTimer = 0.0f; // For crackle noise
+        std::array<double, 7> sawPhases = {0}; // For supersaw
+        
+        // Random number generator for consistent randomness
+        juce::Random random;
+        
+        // Filter state variables
+        float filterState1 = 0.0f;
+        float filterState2 = 0.0f;
+        float filterState3 = 0.0f;
+        float filterState4 = 0.0f;
+        float combDelay[44100] = {0}; // 1 second of delay for comb filter
+        int combIndex = 0;
+        double phaserPhase = 0.0;
+        std::array<float, 4> phaserStages = {0};
+        
+        GranularEngine granular;
+        GlitchEngine glitch;
+        
+    private:
+        void updateIncrements();
+        void resetPhases();
+        int getSupersawSpread() const;
+        float sine(float radians) const;
+        float generateOscillator(WaveType type, float phase, float frequency);
+        float processWeirdOscillator(float baseValue, const NoteWeirdness& nw, float weirdnessAmount);
+        float processChaosFilter(float input, FilterType type, float cutoff, float resonance);
+    };
+    
+    // Notes whose output depends only on (note, knob position, time since note-on)
+    static bool isNoteCacheable(const NoteWeirdness& nw);
+    
+    // The newest note mapping, for threads other than the audio thread
+    RcuPublisher<NoteWeirdnessTable>::Snapshot getNoteWeirdnessSnapshot() const { return noteWeirdness.getLatest(); }
+    
+    // The newest pitch table, for threads other than the audio thread
+    RcuPublisher<PitchTable>::Snapshot getPitchTableSnapshot() const { return pitchTable.getLatest(); }
+
+private:
+    // Parameters
+    juce::AudioProcessorValueTreeState parameters;
+    std::atomic<float>* weirdnessParam = nullptr;
+    juce::RangedAudioParameter* weirdnessParameter = nullptr; // for program changes, which set it
+    std::atomic<float> pendingProgramWeirdness { -1.0f };    // applied on the message thread, -1 for none
+    std::atomic<float>* noteCacheParam = nullptr;
+    std::atomic<float>* autoQualityParam = nullptr;
     
-    WaveType getWaveTypeForNote(int midiNote) const
+    // Parameter values read once per block, so segments never touch the atomics
+    struct ParameterCache
+    {
+        float weirdness = 0.5f;      // value at the start of the next segment
+        float weirdnessStep = 0.0f;  // per-sample ramp towards the host's value
+        bool noteCache = false;
+        bool autoQuality = true;
+        bool valid = false;          // false jumps straight to the host's value
+    };
+    
+    ParameterCache parameterCache;
+    
+    // Longest stretch rendered with one set of per-knob values
+    static constexpr int maxSegmentSize = 32;
+    
+    double currentSampleRate = 44100.0;
+    float amplitude = 0.1f;
+    
+    // MIDI handling
+    int currentNote = -1;  // -1 means no note playing
+    float velocity = 0.0f;
+    
+    // Simple envelope
+    float envelope = 0.0f;
+    float attackTime = 0.01f;  // 10ms attack
+    float releaseTime = 0.1f;  // 100ms release
+    bool noteOn = false;
+    
+    // The synth plays one voice; the effect build processes each input channel with its own
+    static constexpr int numVoices = isAudioEffect ? 2 : 1;
+    std::array<Voice, numVoices> voices;
+    
+    // Built off the audio thread and shared by every instance on the same program
+    RcuPublisher<NoteWeirdnessTable> noteWeirdness { getDefaultNoteWeirdness() };
+    juce::CriticalSection mappingLock;                   // serialises publishing, guards the map state below
+    std::shared_ptr<const PersonalityMap> personalityMap; // applied on top of the program, if any
+    juce::File personalityMapFile;                        // watched for changes
+    juce::Time personalityMapTime;
+    juce::String personalityMapError;
+    std::atomic<bool> programClearsMap { false };         // a host picked a program; the loader drops the map
+    
+    // Tuning source, and its table for the current sample rate
+    juce::CriticalSection tuningLock;                      // serialises publishing, guards the two below
+    std::shared_ptr<const Tuning> tuning { std::make_shared<Tuning>() };
+    double pitchTableSampleRate = 44100.0;
+    RcuPublisher<PitchTable> pitchTable { createPitchTable(Tuning(), 44100.0) };
+    
+    // Modulation routes, and their evaluation lists for the current sample rate
+    juce::CriticalSection modulationLock;                  // serialises publishing, guards the two below
+    std::shared_ptr<const ModMatrix::Settings> modulation { std::make_shared<ModMatrix::Settings>() };
+    double modMatrixSampleRate = 44100.0;
+    RcuPublisher<ModMatrix::Compiled> modMatrix { ModMatrix::compile(ModMatrix::Settings(), 44100.0, maxSegmentSize) };
+    ModMatrix::State modState;
+    NoteWeirdness modulatedNote;                           // only the per-note amounts and types are used
+    
+    std::atomic<juce::int64> noiseSeed { 0 };
+    std::atomic<bool> seedPending { false };              // noiseSeed is still to reach the voices
+    
+    // Frozen-voice playback state
+    std::unique_ptr<NoteCache> noteCache;
+    const float* cachedSamples = nullptr; // null while the live voice is playing
+    int cachedLength = 0;
+    int cachedLoopStart = 0;
+    int cachedPosition = 0;
+    int cachedElapsed = 0;                // samples since note-on, for syncing the live voice
+    int cachedKnobPosition = 0;
+    juce::uint32 cachedTuning = 0;        // pitch table generation the cached note was rendered with
+    int liveFadeRemaining = 0;            // samples left in the cache -> live crossfade
+    int liveFadeLength = 0;
+    int liveWarmUpLength = 0;             // samples the live voice runs silently before taking over
+    
+    // First channel of the output each weird type plays on, 0 for the main output
+    std::array<int, static_cast<size_t>(WeirdType::NUM_TYPES)> weirdTypeChannels {};
+    
+    // CPU-budget quality governor
+    std::atomic<int> qualityTier { 0 };
+    float smoothedLoad = 0.0f;          // render time as a fraction of the block's real-time budget
+    int samplesSinceTierChange = 0;
+    int headroomSamples = 0;            // how long the load has stayed low enough to step back up
+    
+    // Program switches fade the old mapping out and the new one in
+    float programGain = 1.0f;
+    float programGainStep = 0.0f;
+    int programFadeLength = 1;
+    
+    // Audio-thread timeline recorder
+    TraceRecorder trace;
+    
+    // Last, so its thread stops before anything it publishes into goes away
+    ProgramBank programs { [this](int index) { prepareProgram(index); } };
+    
+    // Helper functions
+    static WaveType getWaveTypeForNote(int midiNote)
     {
         int noteInOctave = midiNote % 12;
         return static_cast<WaveType>(noteInOctave);
     }
     
-    FilterType getFilterTypeForNote(int midiNote) const
+    static FilterType getFilterTypeForNote(int midiNote)
     {
         int noteInOctave = midiNote % 12;
         return static_cast<FilterType>(noteInOctave);
     }
     
-    void initializeNoteWeirdness();
-    float generateOscillator(WaveType type, float phase, float frequency);
-    float processWeirdOscillator(float baseValue, int noteNumber, float weirdnessAmount);
-    float processChaosFilter(float input, FilterType type, float cutoff, float resonance);
+    static void initializeNoteWeirdness(NoteWeirdnessTable& table, int variation);
+    static std::shared_ptr<const NoteWeirdnessTable> getDefaultNoteWeirdness();
+    static std::shared_ptr<const NoteWeirdnessTable> getNoteWeirdnessForVariation(int variation);
+    void prepareProgram(int index);
+    void setPersonalityMap(std::shared_ptr<const PersonalityMap> map, const juce::File& file);
+    void publishPitchTable(std::shared_ptr<const Tuning> newTuning, double sampleRate);
+    void updatePitchTable();
+    void publishModulation(std::shared_ptr<const ModMatrix::Settings> settings, double sampleRate);
+    void timerCallback() override;
+    void handleAsyncUpdate() override;
+    void updateNoteMapping();
+    void writeBinaryState(juce::OutputStream& out);
+    bool readBinaryState(juce::InputStream& in);
+    void updateParameterCache(int numSamples);
+    int getKnobPosition() const;
+    void handleMidiMessage(const juce::MidiMessage& message);
+    
+    // The block loop, instantiated for float and double buffers
+    template <typename SampleType>
+    void process(juce::AudioBuffer<SampleType>& buffer, juce::MidiBuffer& midiMessages);
+    template <typename SampleType>
+    void renderBlock(juce::AudioBuffer<SampleType>& buffer, juce::MidiBuffer& midiMessages);
+    template <typename SampleType>
+    void renderSegment(juce::AudioBuffer<SampleType>& buffer, int startSample, int numSamples);
+    
+    void updateQualityGovernor(juce::int64 elapsedTicks, int numSamples);
+    void startCachedNote(int knobPosition);
+    void stopCachedNote();
+    
+    // Only built while a trace is recording, so the hot path just pays for the check
+    TraceRecorder::NoteInfo getTraceInfo(int midiNote) const { return trace.isRecording() ? buildTraceInfo(midiNote) : TraceRecorder::NoteInfo(); }
+    TraceRecorder::NoteInfo buildTraceInfo(int midiNote) const;
     
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FidgetAudioProcessor)
 };
\ No newline at end of file
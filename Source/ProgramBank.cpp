@@ -0,0 +1,118 @@
+#include "ProgramBank.h"
+
+static std::vector<ProgramBank::Program> createFactoryPrograms()
+{
+    return {
+        { "Fidget",   0, 0.5f },
+        { "Twitchy",  1, 0.65f },
+        { "Restless", 2, 0.4f },
+        { "Jittery",  3, 0.8f },
+        { "Squirm",   4, 0.3f },
+        { "Tic",      5, 0.55f },
+        { "Wriggle",  6, 0.7f },
+        { "Antsy",    7, 0.9f }
+    };
+}
+
+// Shared by every bank in the process, and only alive while there is one
+class ProgramBank::Loader : private juce::Thread
+{
+public:
+    Loader() : juce::Thread ("Fidget program loader")
+    {
+        startThread();
+    }
+
+    ~Loader() override
+    {
+        signalThreadShouldExit();
+        notify();
+        stopThread (2000);
+    }
+
+    void add (ProgramBank* bank)
+    {
+        const juce::ScopedLock sl (lock);
+        banks.add (bank);
+    }
+
+    // Waits for the bank's preparation to finish if one is running
+    void remove (ProgramBank* bank)
+    {
+        const juce::ScopedLock sl (lock);
+        banks.removeFirstMatchingValue (bank);
+    }
+
+    void wake() noexcept    { notify(); }
+
+private:
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            wait (-1);
+
+            // Keeps going round until no bank has a request left
+            for (bool busy = true; busy && ! threadShouldExit();)
+            {
+                busy = false;
+                const juce::ScopedLock sl (lock);
+                for (auto* bank : banks)
+                {
+                    const int index = bank->requested.exchange (-1);
+                    if (index >= 0)
+                    {
+                        bank->prepare (index);
+                        busy = true;
+                    }
+                }
+            }
+        }
+    }
+
+    juce::CriticalSection lock; // guards banks, and is held while one is being prepared
+    juce::Array<ProgramBank*> banks;
+};
+
+ProgramBank::ProgramBank (std::function<void (int)> prepareProgram)
+    : prepare (std::move (prepareProgram)),
+      programs (createFactoryPrograms()),
+      numPrograms ((int) programs.size())
+{
+    loader->add (this);
+}
+
+ProgramBank::~ProgramBank()
+{
+    loader->remove (this);
+}
+
+ProgramBank::Program ProgramBank::getProgram (int index) const
+{
+    const juce::ScopedLock sl (lock);
+    return juce::isPositiveAndBelow (index, numPrograms) ? programs[(size_t) index] : Program();
+}
+
+float ProgramBank::getWeirdness (int index) const noexcept
+{
+    // Only names change after construction, so no lock is needed
+    return juce::isPositiveAndBelow (index, numPrograms) ? programs[(size_t) index].weirdness : 0.5f;
+}
+
+void ProgramBank::setProgramName (int index, const juce::String& newName)
+{
+    const juce::ScopedLock sl (lock);
+    if (juce::isPositiveAndBelow (index, numPrograms))
+        programs[(size_t) index].name = newName;
+}
+
+bool ProgramBank::select (int index)
+{
+    if (! juce::isPositiveAndBelow (index, numPrograms))
+        return false;
+
+    current = index;
+    requested = index;
+    loader->wake();
+    return true;
+}
\ No newline at end of file
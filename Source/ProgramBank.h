@@ -0,0 +1,50 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// The factory programs and their (editable) names. Selecting a program queues its
+// preparation on a loader thread, so the caller never waits for the tables to be
+// built; only the most recent selection is prepared if several pile up. One loader
+// thread serves every bank in the process, so idle instances cost no thread.
+// select() only stores an index and wakes the loader, so hosts may call it from
+// the audio thread.
+class ProgramBank
+{
+public:
+    struct Program
+    {
+        juce::String name;
+        int mappingVariation = 0;   // seeds the per-note personalities, 0 is the original mapping
+        float weirdness = 0.5f;
+    };
+
+    // prepareProgram is called on the loader thread with the index to build
+    explicit ProgramBank (std::function<void (int)> prepareProgram);
+    ~ProgramBank();
+
+    int getNumPrograms() const noexcept      { return numPrograms; }
+    int getCurrentProgram() const noexcept   { return current.load(); }
+
+    Program getProgram (int index) const;
+    float getWeirdness (int index) const noexcept; // lock-free, for the audio thread
+    void setProgramName (int index, const juce::String& newName);
+
+    // Makes index the current program and queues its preparation
+    bool select (int index);
+
+private:
+    class Loader;
+
+    std::function<void (int)> prepare;
+
+    juce::CriticalSection lock; // guards programs, whose names hosts may change
+    std::vector<Program> programs;
+    const int numPrograms;
+
+    std::atomic<int> current { 0 };
+    std::atomic<int> requested { -1 };
+
+    juce::SharedResourcePointer<Loader> loader;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ProgramBank)
+};
\ No newline at end of file
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Hands immutable objects from non-realtime threads to the audio thread, RCU style.
+//
+// The audio thread adopts the newest published object with one atomic exchange and
+// never allocates, locks or frees. Each object gets a generation number; the audio
+// thread reports the generation it is using, and everything older is released on
+// the publishing side at the next publish().
+template <typename ObjectType>
+class RcuPublisher
+{
+public:
+    using Pointer = std::shared_ptr<const ObjectType>;
+
+    struct Snapshot
+    {
+        Pointer object;
+        juce::uint32 generation = 0;
+    };
+
+    explicit RcuPublisher (Pointer initial)
+    {
+        auto node = std::make_unique<Node> (Node { std::move (initial), nextGeneration++ });
+        active = node.get();
+        activeGeneration = active->generation;
+        nodes.push_back (std::move (node));
+    }
+
+    //==============================================================================
+    // Non-realtime threads
+
+    void publish (Pointer object)
+    {
+        const juce::ScopedLock sl (lock);
+
+        auto node = std::make_unique<Node> (Node { std::move (object), nextGeneration++ });
+
+        // If the audio thread never picked up the previous one, it never will now
+        if (auto* superseded = pending.exchange (node.get()))
+            removeNode (superseded);
+
+        nodes.push_back (std::move (node));
+        collectGarbage();
+    }
+
+    // The most recently published object, which the audio thread may not have adopted yet
+    Snapshot getLatest() const
+    {
+        const juce::ScopedLock sl (lock);
+        return { nodes.back()->object, nodes.back()->generation };
+    }
+
+    //==============================================================================
+    // Audio thread
+
+    bool hasPending() const noexcept        { return pending.load() != nullptr; }
+
+    // Switches to the newest published object; returns false if there was none
+    bool update() noexcept
+    {
+        auto* next = pending.exchange (nullptr);
+        if (next == nullptr)
+            return false;
+
+        active = next;
+        activeGeneration.store (next->generation);
+        return true;
+    }
+
+    const ObjectType& getActive() const noexcept          { return *active->object; }
+    juce::uint32 getActiveGeneration() const noexcept     { return active->generation; }
+
+private:
+    struct Node
+    {
+        Pointer object;
+        juce::uint32 generation;
+    };
+
+    void collectGarbage()
+    {
+        // Anything older than what the audio thread uses is unreachable from it
+        const auto inUse = activeGeneration.load();
+        nodes.erase (std::remove_if (nodes.begin(), nodes.end() - 1,
+                                     [inUse] (const auto& n) { return n->generation < inUse; }),
+                     nodes.end() - 1);
+    }
+
+    void removeNode (Node* node)
+    {
+        nodes.erase (std::remove_if (nodes.begin(), nodes.end(),
+                                     [node] (const auto& n) { return n.get() == node; }),
+                     nodes.end());
+    }
+
+    juce::CriticalSection lock;
+    std::vector<std::unique_ptr<Node>> nodes;   // oldest first, guarded by lock
+    juce::uint32 nextGeneration = 1;
+
+    std::atomic<Node*> pending { nullptr };
+    Node* active = nullptr;                     // audio thread only
+    std::atomic<juce::uint32> activeGeneration { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE (RcuPublisher)
+};
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include "TraceRecorder.h"
+
+TraceRecorder::TraceRecorder()
+    : juce::Thread ("Fidget trace writer"),
+      ring ((size_t) ringSize)
+{
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    stop();
+}
+
+bool TraceRecorder::start (const juce::File& outputFile)
+{
+    stop();
+
+    // Several instances may share the same path, so never clobber an existing trace
+    auto file = outputFile.existsAsFile() ? outputFile.getNonexistentSibling() : outputFile;
+    stream = std::make_unique<juce::FileOutputStream> (file);
+    if (! stream->openedOk())
+    {
+        stream.reset();
+        return false;
+    }
+
+    droppedEvents = 0;
+    firstEvent = true;
+    startTicks = juce::Time::getHighResolutionTicks();
+
+    // The audio thread may still be finishing a push from the last recording, so the ring is
+    // never reset: the reading side skips what is left, and writeEvent() drops any late arrival
+    fifo.finishedRead (fifo.getNumReady());
+
+    *stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    recording = true;
+    startThread();
+    return true;
+}
+
+void TraceRecorder::stop()
+{
+    if (stream == nullptr)
+        return;
+
+    recording = false;
+    stopThread (1000);
+    drain();
+
+    *stream << "\n]}\n";
+    stream->flush();
+    stream.reset();
+}
+
+void TraceRecorder::push (char phase, const char* name, const NoteInfo& info) noexcept
+{
+    const auto ticks = juce::Time::getHighResolutionTicks();
+
+    int start1, size1, start2, size2;
+    fifo.prepareToWrite (1, start1, size1, start2, size2);
+    if (size1 + size2 < 1)
+    {
+        droppedEvents.fetch_add (1, std::memory_order_relaxed);
+        return;
+    }
+
+    auto& e = ring[(size_t) (size1 > 0 ? start1 : start2)];
+    e.ticks = ticks;
+    e.name = name;
+    e.info = info;
+    e.phase = phase;
+    fifo.finishedWrite (1);
+}
+
+void TraceRecorder::run()
+{
+    while (! threadShouldExit())
+    {
+        wait (50);
+        drain();
+    }
+}
+
+void TraceRecorder::drain()
+{
+    const int numReady = fifo.getNumReady();
+    if (numReady == 0 || stream == nullptr)
+        return;
+
+    int start1, size1, start2, size2;
+    fifo.prepareToRead (numReady, start1, size1, start2, size2);
+
+    for (int i = 0; i < size1; ++i)
+        writeEvent (ring[(size_t) (start1 + i)]);
+    for (int i = 0; i < size2; ++i)
+        writeEvent (ring[(size_t) (start2 + i)]);
+
+    fifo.finishedRead (size1 + size2);
+    stream->flush();
+}
+
+void TraceRecorder::writeEvent (const Event& e)
+{
+    // Pushed before this recording started
+    if (e.ticks < startTicks)
+        return;
+
+    const double micros = juce::Time::highResolutionTicksToSeconds (e.ticks - startTicks) * 1.0e6;
+
+    juce::String json;
+    json << (firstEvent ? "" : ",\n")
+         << "{\"name\":\"" << e.name << "\",\"ph\":\"" << juce::String::charToString (e.phase)
+         << "\",\"ts\":" << juce::String (micros, 3) << ",\"pid\":1,\"tid\":1";
+
+    if (e.phase == 'i')
+        json << ",\"s\":\"t\"";
+
+    if (e.info.note >= 0)
+    {
+        json << ",\"args\":{\"note\":" << juce::String (e.info.note);
+        if (e.info.waveType != nullptr)   json << ",\"wave\":\"" << e.info.waveType << "\"";
+        if (e.info.weirdType != nullptr)  json << ",\"weird\":\"" << e.info.weirdType << "\"";
+        if (e.info.filterType != nullptr) json << ",\"filter\":\"" << e.info.filterType << "\"";
+        json << "}";
+    }
+
+    json << "}";
+    *stream << json;
+    firstEvent = false;
+}
\ No newline at end of file
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Records timestamped begin/end/instant events from the audio thread into a
+// preallocated lock-free ring, and flushes them from a background thread to a
+// Chrome trace JSON file (open it in chrome://tracing or ui.perfetto.dev).
+class TraceRecorder : private juce::Thread
+{
+public:
+    TraceRecorder();
+    ~TraceRecorder() override;
+
+    // Message thread only
+    bool start (const juce::File& outputFile);
+    void stop();
+
+    bool isRecording() const noexcept { return recording.load (std::memory_order_relaxed); }
+    int getNumDroppedEvents() const noexcept { return droppedEvents.load (std::memory_order_relaxed); }
+
+    // Per-event note details shown in the trace viewer's "args" panel.
+    // The names must be string literals (they are stored, not copied).
+    struct NoteInfo
+    {
+        int note = -1;
+        const char* waveType = nullptr;
+        const char* weirdType = nullptr;
+        const char* filterType = nullptr;
+    };
+
+    // Audio thread: never allocate or block, events are dropped if the ring is full
+    void begin (const char* name, const NoteInfo& info) noexcept    { if (isRecording()) push ('B', name, info); }
+    void begin (const char* name) noexcept                          { begin (name, NoteInfo()); }
+    void end (const char* name) noexcept                            { if (isRecording()) push ('E', name, NoteInfo()); }
+    void instant (const char* name, const NoteInfo& info) noexcept  { if (isRecording()) push ('i', name, info); }
+    void instant (const char* name) noexcept                        { instant (name, NoteInfo()); }
+
+    struct ScopedEvent
+    {
+        ScopedEvent (TraceRecorder& t, const char* n, const NoteInfo& info) noexcept : trace (t), name (n) { trace.begin (name, info); }
+        ScopedEvent (TraceRecorder& t, const char* n) noexcept : ScopedEvent (t, n, NoteInfo()) {}
+        ~ScopedEvent() noexcept { trace.end (name); }
+
+        TraceRecorder& trace;
+        const char* name;
+    };
+
+private:
+    struct Event
+    {
+        juce::int64 ticks = 0;
+        const char* name = nullptr;
+        NoteInfo info;
+        char phase = 'i';
+    };
+
+    static constexpr int ringSize = 16384;
+
+    void run() override;
+    void push (char phase, const char* name, const NoteInfo& info) noexcept;
+    void drain();
+    void writeEvent (const Event& e);
+
+    juce::AbstractFifo fifo { ringSize };
+    std::vector<Event> ring;
+    std::unique_ptr<juce::FileOutputStream> stream;
+    std::atomic<bool> recording { false };
+    std::atomic<int> droppedEvents { 0 };
+    juce::int64 startTicks = 0;
+    bool firstEvent = true;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TraceRecorder)
+};
\ No newline at end of file
@@ -0,0 +1,178 @@
+#include "Tuning.h"
+
+namespace
+{
+    // Scala lines starting with '!' are comments; everything else is data, in order
+    juce::StringArray getDataLines (const juce::String& text)
+    {
+        juce::StringArray lines;
+        for (auto& line : juce::StringArray::fromLines (text))
+            if (! line.startsWithChar ('!'))
+                lines.add (line.trim());
+        return lines;
+    }
+
+    // Values may be followed by a comment on the same line
+    juce::String getFirstToken (const juce::String& line)
+    {
+        return juce::StringArray::fromTokens (line.trim(), " \t", {})[0];
+    }
+
+    // Cents if the value has a period, otherwise a ratio ("3/2") or whole number ("2")
+    bool parsePitch (const juce::String& line, double& cents)
+    {
+        const auto token = getFirstToken (line);
+        if (token.isEmpty())
+            return false;
+
+        if (token.containsChar ('.'))
+        {
+            cents = token.getDoubleValue();
+            return true;
+        }
+
+        const double numerator = token.upToFirstOccurrenceOf ("/", false, false).getDoubleValue();
+        const double denominator = token.containsChar ('/') ? token.fromFirstOccurrenceOf ("/", false, false).getDoubleValue() : 1.0;
+        if (numerator <= 0.0 || denominator <= 0.0)
+            return false;
+
+        cents = 1200.0 * std::log2 (numerator / denominator);
+        return true;
+    }
+
+    int floorDivide (int value, int divisor)
+    {
+        return (value >= 0 ? value : value - divisor + 1) / divisor;
+    }
+}
+
+Tuning::Tuning()
+    : name ("12-TET")
+{
+    // The same expression the synth has always used, so default renders do not change
+    for (int note = 0; note < 128; ++note)
+        frequencies[(size_t) note] = 440.0f * std::pow (2.0f, (note - 69) / 12.0f);
+}
+
+juce::Result Tuning::load (const juce::File& scale, const juce::File& keyboardMapping)
+{
+    if (! scale.existsAsFile())
+        return juce::Result::fail ("cannot open " + scale.getFullPathName());
+
+    if (keyboardMapping != juce::File() && ! keyboardMapping.existsAsFile())
+        return juce::Result::fail ("cannot open " + keyboardMapping.getFullPathName());
+
+    auto result = parse (scale.loadFileAsString(),
+                         keyboardMapping != juce::File() ? keyboardMapping.loadFileAsString() : juce::String());
+
+    if (result.wasOk() && name.isEmpty())
+        name = scale.getFileNameWithoutExtension();
+
+    return result;
+}
+
+juce::Result Tuning::parse (const juce::String& newScaleText, const juce::String& newKeyboardMappingText)
+{
+    // Scale: description, number of pitches, then the pitches; the last one is the period
+    const auto scaleLines = getDataLines (newScaleText);
+    if (scaleLines.size() < 2)
+        return juce::Result::fail ("the scale has no pitch count");
+
+    const int scaleSize = getFirstToken (scaleLines[1]).getIntValue();
+    if (scaleSize < 1 || scaleLines.size() < 2 + scaleSize)
+        return juce::Result::fail ("the scale has fewer pitches than it says");
+
+    std::vector<double> degreeCents { 0.0 };
+    for (int i = 0; i < scaleSize; ++i)
+    {
+        double cents = 0.0;
+        if (! parsePitch (scaleLines[2 + i], cents))
+            return juce::Result::fail ("cannot read pitch " + juce::String (i + 1) + ": " + scaleLines[2 + i].quoted());
+        degreeCents.push_back (cents);
+    }
+
+    const double period = degreeCents.back();
+    degreeCents.pop_back();
+    if (period <= 0.0)
+        return juce::Result::fail ("the scale's period must be above 1/1");
+
+    // Keyboard mapping; the default maps every key to the next degree, with degree 0
+    // on middle C and A4 at 440 Hz
+    int mapSize = 0, firstNote = 0, lastNote = 127, middleNote = 60, referenceNote = 69, octaveDegree = scaleSize;
+    double referenceFrequency = 440.0;
+    std::vector<int> mapping; // scale degree per key in the pattern, -1 for unmapped keys
+
+    if (newKeyboardMappingText.isNotEmpty())
+    {
+        auto lines = getDataLines (newKeyboardMappingText);
+        lines.removeEmptyStrings();
+        if (lines.size() < 7)
+            return juce::Result::fail ("the keyboard mapping is incomplete");
+
+        mapSize = getFirstToken (lines[0]).getIntValue();
+        firstNote = juce::jlimit (0, 127, getFirstToken (lines[1]).getIntValue());
+        lastNote = juce::jlimit (0, 127, getFirstToken (lines[2]).getIntValue());
+        middleNote = getFirstToken (lines[3]).getIntValue();
+        referenceNote = getFirstToken (lines[4]).getIntValue();
+        referenceFrequency = getFirstToken (lines[5]).getDoubleValue();
+        octaveDegree = getFirstToken (lines[6]).getIntValue();
+
+        if (mapSize < 0 || mapSize > 128 || referenceFrequency <= 0.0 || ! juce::isPositiveAndBelow (referenceNote, 128))
+            return juce::Result::fail ("the keyboard mapping's header is out of range");
+
+        // Missing entries at the end are unmapped
+        for (int i = 0; i < mapSize; ++i)
+        {
+            const auto token = 7 + i < lines.size() ? getFirstToken (lines[7 + i]) : juce::String ("x");
+            mapping.push_back (token.equalsIgnoreCase ("x") ? -1 : token.getIntValue());
+        }
+
+        if (octaveDegree <= 0)
+            octaveDegree = scaleSize;
+    }
+
+    auto getDegreeCents = [&] (int degree)
+    {
+        const int periods = floorDivide (degree, scaleSize);
+        return periods * period + degreeCents[(size_t) (degree - periods * scaleSize)];
+    };
+
+    auto getNoteCents = [&] (int note, double& cents)
+    {
+        if (note < firstNote || note > lastNote)
+            return false;
+
+        if (mapSize == 0)
+        {
+            cents = getDegreeCents (note - middleNote);
+            return true;
+        }
+
+        // Each repeat of the mapping moves up by the formal octave's interval, which need
+        // not be the scale's period, so it is added as cents rather than as degrees
+        const int repeats = floorDivide (note - middleNote, mapSize);
+        const int mapped = mapping[(size_t) (note - middleNote - repeats * mapSize)];
+        if (mapped < 0)
+            return false;
+
+        cents = getDegreeCents (mapped) + repeats * getDegreeCents (octaveDegree);
+        return true;
+    };
+
+    double referenceCents = 0.0;
+    if (! getNoteCents (referenceNote, referenceCents))
+        return juce::Result::fail ("the reference note is not mapped");
+
+    for (int note = 0; note < 128; ++note)
+    {
+        double cents = 0.0;
+        frequencies[(size_t) note] = getNoteCents (note, cents)
+                                         ? referenceFrequency * std::pow (2.0, (cents - referenceCents) / 1200.0)
+                                         : 0.0;
+    }
+
+    name = scaleLines[0];
+    scaleText = newScaleText;
+    keyboardMappingText = newKeyboardMappingText;
+    return juce::Result::ok();
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// A Scala tuning: a scale (.scl) and an optional keyboard mapping (.kbm), resolved
+// to a frequency for every MIDI note. Notes the mapping leaves out get 0 Hz and do
+// not sound. The default is 12-TET with A4 = 440 Hz.
+class Tuning
+{
+public:
+    Tuning();
+
+    // Reads both files (keyboardMapping may be a default File for the standard mapping)
+    juce::Result load (const juce::File& scale, const juce::File& keyboardMapping);
+
+    // Parses the file contents; on failure this tuning is left as it was
+    juce::Result parse (const juce::String& scaleText, const juce::String& keyboardMappingText);
+
+    double getFrequency (int midiNote) const noexcept    { return frequencies[(size_t) midiNote]; }
+    const juce::String& getName() const noexcept        { return name; }
+    bool isDefault() const noexcept                      { return scaleText.isEmpty(); }
+
+    // The sources, so session state can rebuild the tuning without the files
+    const juce::String& getScaleText() const noexcept            { return scaleText; }
+    const juce::String& getKeyboardMappingText() const noexcept  { return keyboardMappingText; }
+
+private:
+    std::array<double, 128> frequencies {};
+    juce::String name;
+    juce::String scaleText;
+    juce::String keyboardMappingText;
+};
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include <JuceHeader.h>
+#include "Tuning.h"
+
+// Checks the Scala tuning maths against frequencies worked out by hand. Run by ctest;
+// exits non-zero if any check fails.
+
+namespace
+{
+    double centsAbove (double frequency, double cents)
+    {
+        return frequency * std::pow (2.0, cents / 1200.0);
+    }
+
+    class TuningTests : public juce::UnitTest
+    {
+    public:
+        TuningTests() : juce::UnitTest ("Tuning") {}
+
+        void runTest() override
+        {
+            beginTest ("Default tuning is 12-TET at A4 = 440 Hz");
+            {
+                Tuning tuning;
+                expectWithinAbsoluteError (tuning.getFrequency (69), 440.0, 1.0e-3);
+                expectWithinAbsoluteError (tuning.getFrequency (60), 261.6256, 1.0e-3);
+            }
+
+            // Degrees at 0, 150, 400 and 700 cents, repeating every 1200
+            const juce::String scale = "! uneven.scl\n"
+                                       "Uneven four-note scale\n"
+                                       " 4\n"
+                                       " 150.0\n"
+                                       " 400.0\n"
+                                       " 700.0\n"
+                                       " 2/1\n";
+
+            beginTest ("Scale without a keyboard mapping");
+            {
+                Tuning tuning;
+                expect (tuning.parse (scale, {}).wasOk());
+
+                // Degree 0 is middle C and A4 (degree 9) is 440 Hz
+                const double middleC = centsAbove (440.0, -(2 * 1200.0 + 150.0));
+                expectWithinAbsoluteError (tuning.getFrequency (60), middleC, 1.0e-6);
+                expectWithinAbsoluteError (tuning.getFrequency (62), centsAbove (middleC, 400.0), 1.0e-6);
+                expectWithinAbsoluteError (tuning.getFrequency (65), centsAbove (middleC, 1350.0), 1.0e-6);
+                expectWithinAbsoluteError (tuning.getFrequency (59), centsAbove (middleC, -500.0), 1.0e-6);
+            }
+
+            beginTest ("Keyboard mapping whose formal octave is not the scale's period");
+            {
+                // Two keys per repeat, degrees 0 and 1, and each repeat moves up by degree 3
+                // (700 cents) rather than by the 1200 cent period
+                const juce::String keyboardMapping = "! fifths.kbm\n"
+                                                     "2\n"
+                                                     "0\n"
+                                                     "127\n"
+                                                     "60\n"
+                                                     "60\n"
+                                                     "100.0\n"
+                                                     "3\n"
+                                                     "0\n"
+                                                     "1\n";
+
+                Tuning tuning;
+                expect (tuning.parse (scale, keyboardMapping).wasOk());
+
+                expectWithinAbsoluteError (tuning.getFrequency (60), 100.0, 1.0e-6);
+                expectWithinAbsoluteError (tuning.getFrequency (61), centsAbove (100.0, 150.0), 1.0e-6);
+                expectWithinAbsoluteError (tuning.getFrequency (62), centsAbove (100.0, 700.0), 1.0e-6);
+                expectWithinAbsoluteError (tuning.getFrequency (63), centsAbove (100.0, 850.0), 1.0e-6);
+                expectWithinAbsoluteError (tuning.getFrequency (64), centsAbove (100.0, 1400.0), 1.0e-6);
+                expectWithinAbsoluteError (tuning.getFrequency (58), centsAbove (100.0, -700.0), 1.0e-6);
+                expectWithinAbsoluteError (tuning.getFrequency (59), centsAbove (100.0, -550.0), 1.0e-6);
+            }
+
+            beginTest ("Unmapped keys are silent");
+            {
+                const juce::String keyboardMapping = "2\n0\n127\n60\n60\n100.0\n3\n0\nx\n";
+
+                Tuning tuning;
+                expect (tuning.parse (scale, keyboardMapping).wasOk());
+                expectEquals (tuning.getFrequency (61), 0.0);
+                expectEquals (tuning.getFrequency (63), 0.0);
+                expectWithinAbsoluteError (tuning.getFrequency (62), centsAbove (100.0, 700.0), 1.0e-6);
+            }
+        }
+    };
+
+    TuningTests tuningTests;
+}
+
+int main()
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::UnitTestRunner runner;
+    runner.runAllTests();
+
+    for (int i = 0; i < runner.getNumResults(); ++i)
+        if (runner.getResult (i)->failures > 0)
+            return 1;
+
+    return 0;
+}
\ No newline at end of file
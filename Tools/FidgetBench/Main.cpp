@@ -0,0 +1,344 @@
+#include <JuceHeader.h>
+#include <iostream>
+#include "PluginProcessor.h"
+
+#if JUCE_LINUX
+ #include <linux/perf_event.h>
+ #include <sys/ioctl.h>
+ #include <sys/syscall.h>
+ #include <unistd.h>
+#elif JUCE_MAC
+ #include <mach/mach.h>
+#endif
+
+// Instance-density benchmark: how much one FidgetAudioProcessor costs to create and keep
+// around, and how many can process side by side on one core within the real-time budget.
+// Those numbers decide how many tracks fit on a machine.
+//
+// Construction time, resident memory and (on Linux, where perf counters are readable)
+// cache misses are measured per instance. The density search then plays a held note on
+// every instance and processes them one after another, as a host does on a single audio
+// thread, looking for the largest count whose 99th percentile cycle fits the budget.
+
+namespace
+{
+    struct BenchSettings
+    {
+        int maxInstances = 256;
+        double sampleRate = 48000.0;
+        std::vector<int> blockSizes { 64, 128, 256 };
+        double budget = 0.7;          // fraction of each block's duration the instances may use
+        double secondsPerTrial = 2.0;
+        float weirdness = 0.5f;
+        bool autoQuality = false;     // full quality unless asked, so densities are comparable
+    };
+
+    // Resident set size of this process in bytes, or -1 where it cannot be read
+    juce::int64 getResidentBytes()
+    {
+       #if JUCE_LINUX
+        long pages = 0, residentPages = 0;
+        if (auto* statm = std::fopen ("/proc/self/statm", "r"))
+        {
+            const int numRead = std::fscanf (statm, "%ld %ld", &pages, &residentPages);
+            std::fclose (statm);
+            if (numRead == 2)
+                return (juce::int64) residentPages * (juce::int64) sysconf (_SC_PAGESIZE);
+        }
+        return -1;
+       #elif JUCE_MAC
+        mach_task_basic_info info;
+        mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+        if (task_info (mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t) &info, &count) == KERN_SUCCESS)
+            return (juce::int64) info.resident_size;
+        return -1;
+       #else
+        return -1;
+       #endif
+    }
+
+    // Last-level cache misses of this thread between start() and stop(), where the OS allows it
+    class CacheMissCounter
+    {
+    public:
+        CacheMissCounter()
+        {
+           #if JUCE_LINUX
+            perf_event_attr attr {};
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof (attr);
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fd = (int) syscall (__NR_perf_event_open, &attr, 0, -1, -1, 0);
+           #endif
+        }
+
+        ~CacheMissCounter()
+        {
+           #if JUCE_LINUX
+            if (fd >= 0)
+                close (fd);
+           #endif
+        }
+
+        bool isAvailable() const noexcept   { return fd >= 0; }
+
+        void start()
+        {
+           #if JUCE_LINUX
+            if (fd >= 0)
+            {
+                ioctl (fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl (fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+           #endif
+        }
+
+        // The count since start(), or -1 if unavailable
+        juce::int64 stop()
+        {
+           #if JUCE_LINUX
+            long long count = 0;
+            if (fd >= 0)
+            {
+                ioctl (fd, PERF_EVENT_IOC_DISABLE, 0);
+                if (read (fd, &count, sizeof (count)) == (ssize_t) sizeof (count))
+                    return (juce::int64) count;
+            }
+           #endif
+            return -1;
+        }
+
+    private:
+        int fd = -1;
+    };
+
+    // total is -1 where it could not be measured; it is scaled to the unit only after that check
+    juce::String formatPerInstance (juce::int64 total, int numInstances, const juce::String& unit, double unitSize = 1.0)
+    {
+        if (total == -1 || numInstances <= 0)
+            return "n/a";
+        return juce::String ((double) total / unitSize / numInstances, 1) + " " + unit;
+    }
+
+    void prepareInstances (juce::OwnedArray<FidgetAudioProcessor>& instances, double sampleRate, int blockSize)
+    {
+        for (int i = 0; i < instances.size(); ++i)
+        {
+            auto* processor = instances[i];
+            processor->setRateAndBufferSizeDetails (sampleRate, blockSize);
+            processor->prepareToPlay (sampleRate, blockSize);
+            processor->reset();
+        }
+    }
+
+    // Processes the first numInstances instances once per cycle; returns the 99th
+    // percentile cycle time in seconds and adds their cache misses to cacheMisses
+    double runTrial (juce::OwnedArray<FidgetAudioProcessor>& instances, int numInstances, int blockSize,
+                     const BenchSettings& settings, CacheMissCounter& counter, juce::int64& cacheMisses)
+    {
+        juce::AudioBuffer<float> buffer (2, blockSize);
+        juce::MidiBuffer midi;
+        const int numCycles = juce::jmax (1, (int) (settings.secondsPerTrial * settings.sampleRate / blockSize));
+        const int warmupCycles = juce::jmax (1, numCycles / 10);
+
+        // A held note on each, spread over the keyboard so every weird type is represented
+        for (int i = 0; i < numInstances; ++i)
+        {
+            midi.clear();
+            midi.addEvent (juce::MidiMessage::noteOn (1, 24 + (i * 7) % 84, (juce::uint8) 100), 0);
+            buffer.clear();
+            instances[i]->processBlock (buffer, midi);
+        }
+        midi.clear();
+
+        std::vector<double> cycleTimes;
+        cycleTimes.reserve ((size_t) numCycles);
+
+        for (int cycle = -warmupCycles; cycle < numCycles; ++cycle)
+        {
+            if (cycle == 0)
+                counter.start();
+
+            const auto startTicks = juce::Time::getHighResolutionTicks();
+            for (int i = 0; i < numInstances; ++i)
+            {
+                buffer.clear();
+                instances[i]->processBlock (buffer, midi);
+            }
+            const auto elapsedTicks = juce::Time::getHighResolutionTicks() - startTicks;
+
+            if (cycle >= 0)
+                cycleTimes.push_back (juce::Time::highResolutionTicksToSeconds (elapsedTicks));
+        }
+
+        const auto misses = counter.stop();
+        cacheMisses = misses >= 0 ? cacheMisses + misses : -1;
+
+        // Release the notes so the next trial starts from silence
+        for (int i = 0; i < numInstances; ++i)
+            instances[i]->reset();
+
+        const auto index = (size_t) juce::jmax (0, (int) std::ceil (0.99 * (double) cycleTimes.size()) - 1);
+        std::nth_element (cycleTimes.begin(), cycleTimes.begin() + (std::ptrdiff_t) index, cycleTimes.end());
+        return cycleTimes[index];
+    }
+
+    // The largest instance count whose p99 cycle fits the budget: doubles until it does
+    // not, then bisects. Returns 0 if even one instance does not fit.
+    int findMaxInstances (juce::OwnedArray<FidgetAudioProcessor>& instances, int blockSize,
+                          const BenchSettings& settings, CacheMissCounter& counter,
+                          juce::int64& cacheMissesPerBlock)
+    {
+        const double budgetSeconds = settings.budget * blockSize / settings.sampleRate;
+        prepareInstances (instances, settings.sampleRate, blockSize);
+
+        const int maxCount = instances.size();
+        int fits = 0, fails = maxCount + 1;
+        juce::int64 missesAtFit = -1;
+
+        auto tryCount = [&] (int count)
+        {
+            juce::int64 misses = 0;
+            const bool ok = runTrial (instances, count, blockSize, settings, counter, misses) <= budgetSeconds;
+            std::cout << "    " << count << " instances: " << (ok ? "fits" : "over budget") << "\n";
+
+            if (ok)
+            {
+                const int numBlocks = juce::jmax (1, (int) (settings.secondsPerTrial * settings.sampleRate / blockSize)) * count;
+                fits = count;
+                missesAtFit = misses >= 0 ? misses / numBlocks : -1;
+            }
+            else
+            {
+                fails = count;
+            }
+            return ok;
+        };
+
+        for (int count = 1; tryCount (count) && count < maxCount;)
+            count = juce::jmin (count * 2, maxCount);
+
+        while (fails <= maxCount && fails - fits > 1)
+            tryCount ((fits + fails) / 2);
+
+        for (auto* processor : instances)
+            processor->releaseResources();
+
+        cacheMissesPerBlock = missesAtFit;
+        return fits;
+    }
+
+    template <typename ValueType>
+    std::vector<ValueType> parseList (const juce::String& text)
+    {
+        std::vector<ValueType> values;
+        for (auto& token : juce::StringArray::fromTokens (text, ",", {}))
+            if (token.trim().isNotEmpty())
+                values.push_back ((ValueType) token.trim().getDoubleValue());
+        return values;
+    }
+
+    void printUsage()
+    {
+        std::cout << "Usage: FidgetBench [options]\n"
+                     "  --instances <n>            most instances to create (default: 256)\n"
+                     "  --sample-rate <hz>         (default: 48000)\n"
+                     "  --block-sizes <list>       comma-separated (default: 64,128,256)\n"
+                     "  --budget <fraction>        share of each block's duration the instances may use (default: 0.7)\n"
+                     "  --seconds <s>              audio processed per density trial (default: 2)\n"
+                     "  --weirdness <0..1>         knob position (default: 0.5)\n"
+                     "  --auto-quality             let the CPU quality governor step down under load\n";
+    }
+}
+
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::ArgumentList args (argc, argv);
+    if (args.containsOption ("--help|-h"))
+    {
+        printUsage();
+        return 0;
+    }
+
+    BenchSettings settings;
+    if (args.containsOption ("--instances"))       settings.maxInstances = args.getValueForOption ("--instances").getIntValue();
+    if (args.containsOption ("--sample-rate"))     settings.sampleRate = args.getValueForOption ("--sample-rate").getDoubleValue();
+    if (args.containsOption ("--block-sizes"))     settings.blockSizes = parseList<int> (args.getValueForOption ("--block-sizes"));
+    if (args.containsOption ("--budget"))          settings.budget = args.getValueForOption ("--budget").getDoubleValue();
+    if (args.containsOption ("--seconds"))         settings.secondsPerTrial = args.getValueForOption ("--seconds").getDoubleValue();
+    if (args.containsOption ("--weirdness"))       settings.weirdness = juce::jlimit (0.0f, 1.0f, args.getValueForOption ("--weirdness").getFloatValue());
+    settings.autoQuality = args.containsOption ("--auto-quality");
+
+    if (settings.maxInstances <= 0 || settings.sampleRate <= 0.0 || settings.budget <= 0.0 || settings.secondsPerTrial <= 0.0
+        || settings.blockSizes.empty() || *std::min_element (settings.blockSizes.begin(), settings.blockSizes.end()) <= 0)
+    {
+        std::cerr << "Instances, sample rate, block sizes, budget and seconds must be positive\n";
+        return 1;
+    }
+
+    CacheMissCounter counter;
+    juce::OwnedArray<FidgetAudioProcessor> instances;
+
+    // The first instance also builds the tables all instances share, so it is timed on its own
+    std::cout << "Creating " << settings.maxInstances << " instances\n";
+    const auto residentBefore = getResidentBytes();
+    double firstSeconds = 0.0, totalSeconds = 0.0;
+
+    counter.start();
+    for (int i = 0; i < settings.maxInstances; ++i)
+    {
+        const auto startTicks = juce::Time::getHighResolutionTicks();
+        auto* processor = instances.add (new FidgetAudioProcessor());
+        const auto seconds = juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - startTicks);
+
+        if (i == 0)
+            firstSeconds = seconds;
+        totalSeconds += seconds;
+
+        auto& parameters = processor->getParameters();
+        parameters.getParameter ("weirdness")->setValueNotifyingHost (settings.weirdness);
+        parameters.getParameter ("autoQuality")->setValueNotifyingHost (settings.autoQuality ? 1.0f : 0.0f);
+    }
+    const auto constructionMisses = counter.stop();
+    const auto residentConstructed = getResidentBytes();
+
+    // Buffers sized by the sample rate only exist after prepareToPlay
+    prepareInstances (instances, settings.sampleRate, settings.blockSizes.front());
+    const auto residentPrepared = getResidentBytes();
+
+    const int n = instances.size();
+    auto delta = [] (juce::int64 after, juce::int64 before) { return after >= 0 && before >= 0 ? after - before : (juce::int64) -1; };
+
+    std::cout << "  construction, first:       " << juce::String (firstSeconds * 1.0e3, 3) << " ms\n"
+              << "  construction, per other:   " << juce::String (n > 1 ? (totalSeconds - firstSeconds) * 1.0e3 / (n - 1) : 0.0, 3) << " ms\n"
+              << "  resident, constructed:     " << formatPerInstance (delta (residentConstructed, residentBefore), n, "KB", 1024.0) << " per instance\n"
+              << "  resident, prepared:        " << formatPerInstance (delta (residentPrepared, residentBefore), n, "KB", 1024.0) << " per instance\n"
+              << "  cache misses, construction: " << formatPerInstance (constructionMisses, n, "") << " per instance\n";
+
+    for (auto* processor : instances)
+        processor->releaseResources();
+
+    std::cout << "\nDensity at " << juce::String (settings.sampleRate, 0) << " Hz, "
+              << juce::roundToInt (settings.budget * 100.0) << "% of each block's duration\n";
+
+    juce::StringArray summary;
+    for (auto blockSize : settings.blockSizes)
+    {
+        std::cout << "  " << blockSize << " samples\n";
+        juce::int64 missesPerBlock = -1;
+        const int maxInstances = findMaxInstances (instances, blockSize, settings, counter, missesPerBlock);
+
+        summary.add ("  " + juce::String (blockSize).paddedLeft (' ', 5) + " samples: "
+                     + juce::String (maxInstances).paddedLeft (' ', 5) + (maxInstances == n ? "+" : " ") + " instances"
+                     + (missesPerBlock >= 0 ? ", " + juce::String (missesPerBlock) + " cache misses per instance block" : juce::String()));
+    }
+
+    std::cout << "\nMost instances within budget" << (counter.isAvailable() ? "" : " (cache counters unavailable)") << "\n"
+              << summary.joinIntoString ("\n") << "\n";
+    return 0;
+}
\ No newline at end of file
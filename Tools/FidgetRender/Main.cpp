@@ -0,0 +1,306 @@
+#include <JuceHeader.h>
+#include <iostream>
+#include "PluginProcessor.h"
+
+// Renders .mid files through FidgetAudioProcessor without a host.
+//
+// Every file is rendered by a processor that has been reset and re-seeded, so
+// the output only depends on the file and the options, never on which worker
+// picked it up or how many workers there are.
+
+namespace
+{
+    struct RenderSettings
+    {
+        double sampleRate = 48000.0;
+        int blockSize = 512;
+        int bitDepth = 24;
+        bool flac = false;
+        float weirdnessStart = 0.5f;
+        float weirdnessEnd = 0.5f;    // differs from start for a linear sweep across the file
+        int weirdnessController = -1; // MIDI CC mapped onto the knob, -1 for none
+        double tailSeconds = 1.0;
+        juce::int64 seed = 1;
+        ModMatrix::Settings modulation;
+        juce::File outputDir;         // empty to write next to each input file
+    };
+
+    juce::File getOutputFile (const juce::File& midiFile, const RenderSettings& settings)
+    {
+        const auto dir = settings.outputDir == juce::File() ? midiFile.getParentDirectory() : settings.outputDir;
+        return dir.getChildFile (midiFile.getFileNameWithoutExtension()).withFileExtension (settings.flac ? "flac" : "wav");
+    }
+
+    juce::Result renderFile (FidgetAudioProcessor& processor, const juce::File& midiFile, const RenderSettings& settings)
+    {
+        juce::MidiFile file;
+        {
+            juce::FileInputStream in (midiFile);
+            if (! in.openedOk() || ! file.readFrom (in))
+                return juce::Result::fail ("cannot read MIDI file");
+        }
+        file.convertTimestampTicksToSeconds();
+
+        juce::MidiMessageSequence sequence;
+        for (int track = 0; track < file.getNumTracks(); ++track)
+            sequence.addSequence (*file.getTrack (track), 0.0);
+
+        const auto outFile = getOutputFile (midiFile, settings);
+        outFile.deleteFile();
+
+        auto stream = outFile.createOutputStream();
+        if (stream == nullptr)
+            return juce::Result::fail ("cannot create " + outFile.getFullPathName());
+
+        juce::WavAudioFormat wav;
+        juce::FlacAudioFormat flac;
+        auto& format = settings.flac ? static_cast<juce::AudioFormat&> (flac) : static_cast<juce::AudioFormat&> (wav);
+
+        std::unique_ptr<juce::AudioFormatWriter> writer (format.createWriterFor (stream.get(), settings.sampleRate, 2,
+                                                                                 settings.bitDepth, {}, 0));
+        if (writer == nullptr)
+            return juce::Result::fail ("unsupported format settings");
+        stream.release(); // now owned by the writer
+
+        processor.setRandomSeed (settings.seed);
+        processor.setNonRealtime (true);
+        processor.setRateAndBufferSizeDetails (settings.sampleRate, settings.blockSize);
+        processor.prepareToPlay (settings.sampleRate, settings.blockSize);
+        processor.reset();
+
+        auto* weirdness = processor.getParameters().getParameter ("weirdness");
+        weirdness->setValueNotifyingHost (weirdness->convertTo0to1 (settings.weirdnessStart));
+
+        const auto totalSamples = (juce::int64) std::ceil ((sequence.getEndTime() + settings.tailSeconds) * settings.sampleRate);
+
+        juce::AudioBuffer<float> buffer (2, settings.blockSize);
+        juce::MidiBuffer midi;
+        int nextEvent = 0;
+
+        for (juce::int64 blockStart = 0; blockStart < totalSamples;)
+        {
+            auto blockEnd = juce::jmin (blockStart + settings.blockSize, totalSamples);
+
+            // The processor ramps to the knob's new value across the block, so set
+            // the value for the end of the block
+            if (settings.weirdnessEnd != settings.weirdnessStart)
+            {
+                const auto progress = (float) blockEnd / (float) totalSamples;
+                weirdness->setValueNotifyingHost (weirdness->convertTo0to1 (settings.weirdnessStart
+                                                  + progress * (settings.weirdnessEnd - settings.weirdnessStart)));
+            }
+
+            midi.clear();
+            for (; nextEvent < sequence.getNumEvents(); ++nextEvent)
+            {
+                const auto& message = sequence.getEventPointer (nextEvent)->message;
+                const auto position = (juce::int64) std::llround (message.getTimeStamp() * settings.sampleRate);
+                if (position >= blockEnd)
+                    break;
+
+                if (message.isController() && message.getControllerNumber() == settings.weirdnessController)
+                {
+                    // End the block at the controller event, so the ramp lands on it exactly
+                    weirdness->setValueNotifyingHost (message.getControllerValue() / 127.0f);
+                    if (position > blockStart)
+                    {
+                        blockEnd = position;
+                        ++nextEvent;
+                        break;
+                    }
+                }
+                else if (! message.isMetaEvent())
+                {
+                    midi.addEvent (message, (int) juce::jmax ((juce::int64) 0, position - blockStart));
+                }
+            }
+
+            const int numSamples = (int) (blockEnd - blockStart);
+            buffer.setSize (2, numSamples, false, false, true);
+            buffer.clear();
+            processor.processBlock (buffer, midi);
+
+            if (! writer->writeFromAudioSampleBuffer (buffer, 0, numSamples))
+                return juce::Result::fail ("write failed for " + outFile.getFullPathName());
+
+            blockStart = blockEnd;
+        }
+
+        processor.releaseResources();
+        return juce::Result::ok();
+    }
+
+    // Owns one processor and pulls files off the shared queue until it is empty
+    class RenderWorker : public juce::Thread
+    {
+    public:
+        RenderWorker (const juce::Array<juce::File>& filesToRender, juce::Array<juce::Result>& resultsToFill,
+                      std::atomic<int>& nextFileIndex, const RenderSettings& renderSettings)
+            : juce::Thread ("FidgetRender worker"),
+              files (filesToRender), results (resultsToFill), nextFile (nextFileIndex), settings (renderSettings)
+        {
+            processor.setModulation (settings.modulation);
+        }
+
+        void run() override
+        {
+            for (int index = nextFile++; index < files.size(); index = nextFile++)
+                results.getReference (index) = renderFile (processor, files[index], settings);
+        }
+
+    private:
+        FidgetAudioProcessor processor;
+        const juce::Array<juce::File>& files;
+        juce::Array<juce::Result>& results;
+        std::atomic<int>& nextFile;
+        const RenderSettings& settings;
+    };
+
+    void printUsage()
+    {
+        std::cout << "Usage: FidgetRender [options] <file.mid>...\n"
+                     "  --output-dir <dir>         where to write the renders (default: next to each .mid)\n"
+                     "  --format wav|flac          output format (default: wav)\n"
+                     "  --bits <16|24|32>          output bit depth (default: 24)\n"
+                     "  --sample-rate <hz>         render sample rate (default: 48000)\n"
+                     "  --block-size <samples>     processBlock size (default: 512)\n"
+                     "  --threads <n>              worker threads (default: number of CPUs)\n"
+                     "  --weirdness <0..1>         fixed knob position (default: 0.5)\n"
+                     "  --weirdness-sweep <a:b>    sweep the knob linearly from a to b over each file\n"
+                     "  --weirdness-cc <n>         drive the knob from MIDI controller n in the file\n"
+                     "  --tail <seconds>           extra time rendered after the last event (default: 1)\n"
+                     "  --seed <n>                 noise seed (default: 1)\n"
+                     "  --modulation <file.json>   modulation matrix routes (default: none)\n";
+    }
+}
+
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::ArgumentList args (argc, argv);
+    if (args.size() == 0 || args.containsOption ("--help|-h"))
+    {
+        printUsage();
+        return args.size() == 0 ? 1 : 0;
+    }
+
+    RenderSettings settings;
+    int numThreads = juce::SystemStats::getNumCpus();
+
+    if (args.containsOption ("--output-dir"))      settings.outputDir = args.getFileForOption ("--output-dir");
+    if (args.containsOption ("--format"))          settings.flac = args.getValueForOption ("--format").equalsIgnoreCase ("flac");
+    if (args.containsOption ("--bits"))            settings.bitDepth = args.getValueForOption ("--bits").getIntValue();
+    if (args.containsOption ("--sample-rate"))     settings.sampleRate = args.getValueForOption ("--sample-rate").getDoubleValue();
+    if (args.containsOption ("--block-size"))      settings.blockSize = args.getValueForOption ("--block-size").getIntValue();
+    if (args.containsOption ("--threads"))         numThreads = args.getValueForOption ("--threads").getIntValue();
+    if (args.containsOption ("--weirdness-cc"))    settings.weirdnessController = args.getValueForOption ("--weirdness-cc").getIntValue();
+    if (args.containsOption ("--tail"))            settings.tailSeconds = args.getValueForOption ("--tail").getDoubleValue();
+    if (args.containsOption ("--seed"))            settings.seed = args.getValueForOption ("--seed").getLargeIntValue();
+
+    if (args.containsOption ("--weirdness"))
+        settings.weirdnessStart = settings.weirdnessEnd = juce::jlimit (0.0f, 1.0f, args.getValueForOption ("--weirdness").getFloatValue());
+
+    if (args.containsOption ("--weirdness-sweep"))
+    {
+        auto sweep = args.getValueForOption ("--weirdness-sweep");
+        settings.weirdnessStart = juce::jlimit (0.0f, 1.0f, sweep.upToFirstOccurrenceOf (":", false, false).getFloatValue());
+        settings.weirdnessEnd = juce::jlimit (0.0f, 1.0f, sweep.fromFirstOccurrenceOf (":", false, false).getFloatValue());
+    }
+
+    if (args.containsOption ("--modulation"))
+    {
+        auto file = args.getFileForOption ("--modulation");
+        auto result = file.existsAsFile() ? settings.modulation.parseJson (file.loadFileAsString())
+                                          : juce::Result::fail ("cannot open " + file.getFullPathName());
+        if (result.failed())
+        {
+            std::cerr << "Bad modulation: " << result.getErrorMessage() << "\n";
+            return 1;
+        }
+    }
+
+    if (settings.sampleRate <= 0.0 || settings.blockSize <= 0)
+    {
+        std::cerr << "Sample rate and block size must be positive\n";
+        return 1;
+    }
+
+    // Everything that is not an option (or an option's value) is an input file
+    juce::Array<juce::File> files;
+    for (int i = 0; i < args.size(); ++i)
+    {
+        if (args[i].isOption())
+        {
+            if (! args[i].text.containsChar ('=') && i + 1 < args.size() && ! args[i + 1].isOption())
+                ++i;
+            continue;
+        }
+
+        files.add (args[i].resolveAsFile());
+    }
+
+    if (files.isEmpty())
+    {
+        printUsage();
+        return 1;
+    }
+
+    // Inputs with the same base name (song.mid and song.MID, or a/song.mid and b/song.mid with
+    // --output-dir) would overwrite each other's renders, so none are rendered
+    bool clashes = false;
+    for (int i = 0; i < files.size(); ++i)
+    {
+        for (int j = 0; j < i; ++j)
+        {
+            if (getOutputFile (files[i], settings) == getOutputFile (files[j], settings))
+            {
+                std::cerr << files[j].getFullPathName() << " and " << files[i].getFullPathName() << " would both render to "
+                          << getOutputFile (files[i], settings).getFullPathName() << "\n";
+                clashes = true;
+                break;
+            }
+        }
+    }
+
+    if (clashes)
+        return 1;
+
+    if (settings.outputDir != juce::File() && ! settings.outputDir.createDirectory().wasOk())
+    {
+        std::cerr << "Cannot create " << settings.outputDir.getFullPathName() << "\n";
+        return 1;
+    }
+
+    juce::Array<juce::Result> results;
+    results.insertMultiple (0, juce::Result::fail ("not rendered"), files.size());
+
+    std::atomic<int> nextFile { 0 };
+    numThreads = juce::jlimit (1, files.size(), numThreads);
+
+    // Processors are built here rather than on the workers, on the message thread
+    juce::OwnedArray<RenderWorker> workers;
+    for (int i = 0; i < numThreads; ++i)
+        workers.add (new RenderWorker (files, results, nextFile, settings));
+
+    for (auto* worker : workers)
+        worker->startThread();
+    for (auto* worker : workers)
+        worker->waitForThreadToExit (-1);
+
+    int numFailed = 0;
+    for (int i = 0; i < files.size(); ++i)
+    {
+        if (results[i].wasOk())
+        {
+            std::cout << "rendered " << files[i].getFullPathName() << "\n";
+        }
+        else
+        {
+            std::cerr << "failed   " << files[i].getFullPathName() << ": " << results[i].getErrorMessage() << "\n";
+            ++numFailed;
+        }
+    }
+
+    return numFailed == 0 ? 0 : 1;
+}
\ No newline at end of file
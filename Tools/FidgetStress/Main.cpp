@@ -0,0 +1,295 @@
+#include <JuceHeader.h>
+#include <iostream>
+#include "PluginProcessor.h"
+
+// Hunts for worst-case blocks rather than average CPU. Drives FidgetAudioProcessor with
+// random MIDI storms and fast knob sweeps at odd block sizes, changing the sample rate
+// through prepareToPlay between runs, times every processBlock call and checks every
+// output sample for NaN, Inf and denormals.
+//
+// Exits non-zero when the output is bad or a limit given on the command line is exceeded,
+// so releases can be gated on it. Runs are seeded, so a failure can be replayed.
+
+namespace
+{
+    struct StressSettings
+    {
+        std::vector<double> sampleRates { 44100.0, 48000.0, 96000.0, 192000.0 };
+        std::vector<int> blockSizes { 1, 7, 64, 512, 4096 };
+        double secondsPerRun = 5.0;
+        double stormsPerSecond = 20.0;
+        juce::int64 seed = 1;
+        bool autoQuality = false;     // lets the quality governor step down, so worst cases hide
+        bool noteCache = false;
+        bool doublePrecision = false; // drives the double processBlock, as a 64-bit host would
+        double maxLoad = 0.0;         // limit on the slowest block, as a fraction of its duration; 0 for none
+        double maxP99Load = 0.0;      // the same for the 99th percentile
+        juce::File reportFile;
+    };
+
+    struct RunResult
+    {
+        double sampleRate = 0.0;
+        int blockSize = 0;
+        int numBlocks = 0;
+        double budget = 0.0;          // real-time duration of one block, in microseconds
+        double p50 = 0.0, p99 = 0.0, max = 0.0;
+        juce::int64 numNaN = 0, numInf = 0, numDenormal = 0;
+
+        bool hasBadOutput() const noexcept   { return numNaN + numInf + numDenormal > 0; }
+    };
+
+    // Note-ons and note-offs piled onto a few samples, sometimes every key at once
+    void addStorm (juce::MidiBuffer& midi, juce::Random& random, int position, int blockSize)
+    {
+        if (random.nextInt (8) == 0)
+        {
+            for (int note = 0; note < 128; ++note)
+                midi.addEvent (juce::MidiMessage::noteOn (1, note, (juce::uint8) (1 + random.nextInt (127))), position);
+            for (int note = 0; note < 128; ++note)
+                midi.addEvent (juce::MidiMessage::noteOff (1, note), position);
+            return;
+        }
+
+        const int numEvents = 1 + random.nextInt (32);
+        for (int i = 0; i < numEvents; ++i)
+        {
+            const int eventPosition = juce::jmin (blockSize - 1, position + random.nextInt (8));
+            const int note = random.nextInt (128);
+            if (random.nextBool())
+                midi.addEvent (juce::MidiMessage::noteOn (1, note, (juce::uint8) (1 + random.nextInt (127))), eventPosition);
+            else
+                midi.addEvent (juce::MidiMessage::noteOff (1, note), eventPosition);
+        }
+    }
+
+    double getPercentile (std::vector<double>& values, double percentile)
+    {
+        if (values.empty())
+            return 0.0;
+
+        const auto index = (size_t) juce::jlimit (0.0, (double) values.size() - 1.0, std::ceil (percentile * (double) values.size()) - 1.0);
+        std::nth_element (values.begin(), values.begin() + (std::ptrdiff_t) index, values.end());
+        return values[index];
+    }
+
+    RunResult runStress (FidgetAudioProcessor& processor, double sampleRate, int blockSize,
+                         const StressSettings& settings, juce::Random& random)
+    {
+        RunResult result;
+        result.sampleRate = sampleRate;
+        result.blockSize = blockSize;
+        result.budget = 1.0e6 * blockSize / sampleRate;
+
+        // No reset(): whatever was playing carries over the rate change, as in a host
+        processor.setProcessingPrecision (settings.doublePrecision ? juce::AudioProcessor::doublePrecision
+                                                                   : juce::AudioProcessor::singlePrecision);
+        processor.setRateAndBufferSizeDetails (sampleRate, blockSize);
+        processor.prepareToPlay (sampleRate, blockSize);
+
+        auto* weirdness = processor.getParameters().getParameter ("weirdness");
+        const auto totalSamples = (juce::int64) (settings.secondsPerRun * sampleRate);
+        const double meanStormGap = sampleRate / juce::jmax (0.001, settings.stormsPerSecond);
+        auto samplesUntilStorm = (juce::int64) (random.nextDouble() * 2.0 * meanStormGap);
+
+        juce::AudioBuffer<float> floatBuffer (2, settings.doublePrecision ? 0 : blockSize);
+        juce::AudioBuffer<double> doubleBuffer (2, settings.doublePrecision ? blockSize : 0);
+        juce::MidiBuffer midi;
+        std::vector<double> blockTimes;
+        blockTimes.reserve ((size_t) (totalSamples / blockSize + 1));
+
+        auto processBlock = [&] (auto& buffer)
+        {
+            buffer.clear();
+
+            const auto startTicks = juce::Time::getHighResolutionTicks();
+            processor.processBlock (buffer, midi);
+            const auto elapsedTicks = juce::Time::getHighResolutionTicks() - startTicks;
+            blockTimes.push_back (1.0e6 * juce::Time::highResolutionTicksToSeconds (elapsedTicks));
+
+            for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+            {
+                const auto* samples = buffer.getReadPointer (channel);
+                for (int i = 0; i < blockSize; ++i)
+                {
+                    switch (std::fpclassify (samples[i]))
+                    {
+                        case FP_NAN:        ++result.numNaN; break;
+                        case FP_INFINITE:   ++result.numInf; break;
+                        case FP_SUBNORMAL:  ++result.numDenormal; break;
+                        default:            break;
+                    }
+                }
+            }
+        };
+
+        for (juce::int64 blockStart = 0; blockStart < totalSamples; blockStart += blockSize)
+        {
+            // A 20 Hz triangle sweep, with a jump to a random position at every storm
+            const double time = (double) blockStart / sampleRate;
+            float knob = (float) std::abs (2.0 * (time * 20.0 - std::floor (time * 20.0 + 0.5)));
+
+            midi.clear();
+            while (samplesUntilStorm < blockSize)
+            {
+                addStorm (midi, random, (int) samplesUntilStorm, blockSize);
+                knob = random.nextFloat();
+                samplesUntilStorm += 1 + (juce::int64) (random.nextDouble() * 2.0 * meanStormGap);
+            }
+            samplesUntilStorm -= blockSize;
+
+            weirdness->setValueNotifyingHost (knob);
+
+            if (settings.doublePrecision)
+                processBlock (doubleBuffer);
+            else
+                processBlock (floatBuffer);
+        }
+
+        processor.releaseResources();
+
+        result.numBlocks = (int) blockTimes.size();
+        result.max = blockTimes.empty() ? 0.0 : *std::max_element (blockTimes.begin(), blockTimes.end());
+        result.p99 = getPercentile (blockTimes, 0.99);
+        result.p50 = getPercentile (blockTimes, 0.5);
+        return result;
+    }
+
+    juce::String toJson (const juce::Array<RunResult>& results, const StressSettings& settings, bool passed)
+    {
+        juce::Array<juce::var> runs;
+        for (const auto& r : results)
+        {
+            auto* run = new juce::DynamicObject();
+            run->setProperty ("sampleRate", r.sampleRate);
+            run->setProperty ("blockSize", r.blockSize);
+            run->setProperty ("blocks", r.numBlocks);
+            run->setProperty ("budgetMicros", r.budget);
+            run->setProperty ("p50Micros", r.p50);
+            run->setProperty ("p99Micros", r.p99);
+            run->setProperty ("maxMicros", r.max);
+            run->setProperty ("nan", r.numNaN);
+            run->setProperty ("inf", r.numInf);
+            run->setProperty ("denormal", r.numDenormal);
+            runs.add (juce::var (run));
+        }
+
+        auto* report = new juce::DynamicObject();
+        report->setProperty ("seed", settings.seed);
+        report->setProperty ("secondsPerRun", settings.secondsPerRun);
+        report->setProperty ("autoQuality", settings.autoQuality);
+        report->setProperty ("doublePrecision", settings.doublePrecision);
+        report->setProperty ("passed", passed);
+        report->setProperty ("runs", runs);
+        return juce::JSON::toString (juce::var (report));
+    }
+
+    template <typename ValueType>
+    std::vector<ValueType> parseList (const juce::String& text)
+    {
+        std::vector<ValueType> values;
+        for (auto& token : juce::StringArray::fromTokens (text, ",", {}))
+            if (token.trim().isNotEmpty())
+                values.push_back ((ValueType) token.trim().getDoubleValue());
+        return values;
+    }
+
+    void printUsage()
+    {
+        std::cout << "Usage: FidgetStress [options]\n"
+                     "  --sample-rates <list>      comma-separated, run in order (default: 44100,48000,96000,192000)\n"
+                     "  --block-sizes <list>       comma-separated (default: 1,7,64,512,4096)\n"
+                     "  --seconds <s>              audio rendered per sample rate and block size (default: 5)\n"
+                     "  --storms <n>               MIDI storms per second (default: 20)\n"
+                     "  --seed <n>                 random seed (default: 1)\n"
+                     "  --auto-quality             let the CPU quality governor step down under load\n"
+                     "  --note-cache               turn frozen-note playback on\n"
+                     "  --double                   process 64-bit buffers\n"
+                     "  --max-load <fraction>      fail if any block takes longer than this fraction of its duration\n"
+                     "  --max-p99-load <fraction>  fail if the 99th percentile block does\n"
+                     "  --report <file.json>       write the results as JSON\n";
+    }
+}
+
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::ArgumentList args (argc, argv);
+    if (args.containsOption ("--help|-h"))
+    {
+        printUsage();
+        return 0;
+    }
+
+    StressSettings settings;
+    if (args.containsOption ("--sample-rates"))    settings.sampleRates = parseList<double> (args.getValueForOption ("--sample-rates"));
+    if (args.containsOption ("--block-sizes"))     settings.blockSizes = parseList<int> (args.getValueForOption ("--block-sizes"));
+    if (args.containsOption ("--seconds"))         settings.secondsPerRun = args.getValueForOption ("--seconds").getDoubleValue();
+    if (args.containsOption ("--storms"))          settings.stormsPerSecond = args.getValueForOption ("--storms").getDoubleValue();
+    if (args.containsOption ("--seed"))            settings.seed = args.getValueForOption ("--seed").getLargeIntValue();
+    if (args.containsOption ("--max-load"))        settings.maxLoad = args.getValueForOption ("--max-load").getDoubleValue();
+    if (args.containsOption ("--max-p99-load"))    settings.maxP99Load = args.getValueForOption ("--max-p99-load").getDoubleValue();
+    if (args.containsOption ("--report"))          settings.reportFile = args.getFileForOption ("--report");
+    settings.autoQuality = args.containsOption ("--auto-quality");
+    settings.noteCache = args.containsOption ("--note-cache");
+    settings.doublePrecision = args.containsOption ("--double");
+
+    auto isPositive = [] (auto value) { return value > 0; };
+    if (settings.sampleRates.empty() || settings.blockSizes.empty() || settings.secondsPerRun <= 0.0
+        || ! std::all_of (settings.sampleRates.begin(), settings.sampleRates.end(), isPositive)
+        || ! std::all_of (settings.blockSizes.begin(), settings.blockSizes.end(), isPositive))
+    {
+        std::cerr << "Sample rates, block sizes and seconds must be positive\n";
+        return 1;
+    }
+
+    FidgetAudioProcessor processor;
+    processor.setRandomSeed (settings.seed);
+    processor.setNonRealtime (false);
+
+    auto& parameters = processor.getParameters();
+    parameters.getParameter ("autoQuality")->setValueNotifyingHost (settings.autoQuality ? 1.0f : 0.0f);
+    parameters.getParameter ("noteCache")->setValueNotifyingHost (settings.noteCache ? 1.0f : 0.0f);
+
+    juce::Random random (settings.seed);
+    juce::Array<RunResult> results;
+    bool passed = true;
+
+    std::cout << "  rate  block    blocks   budget us      p50 us      p99 us      max us  max load   nan   inf  denormal\n";
+
+    for (auto sampleRate : settings.sampleRates)
+    {
+        for (auto blockSize : settings.blockSizes)
+        {
+            const auto r = runStress (processor, sampleRate, blockSize, settings, random);
+            results.add (r);
+
+            const bool overLimit = (settings.maxLoad > 0.0 && r.max > settings.maxLoad * r.budget)
+                                || (settings.maxP99Load > 0.0 && r.p99 > settings.maxP99Load * r.budget);
+            passed = passed && ! overLimit && ! r.hasBadOutput();
+
+            std::cout << juce::String (r.sampleRate, 0).paddedLeft (' ', 6)
+                      << juce::String (r.blockSize).paddedLeft (' ', 7)
+                      << juce::String (r.numBlocks).paddedLeft (' ', 10)
+                      << juce::String (r.budget, 1).paddedLeft (' ', 12)
+                      << juce::String (r.p50, 1).paddedLeft (' ', 12)
+                      << juce::String (r.p99, 1).paddedLeft (' ', 12)
+                      << juce::String (r.max, 1).paddedLeft (' ', 12)
+                      << juce::String (r.max / r.budget, 2).paddedLeft (' ', 10)
+                      << juce::String (r.numNaN).paddedLeft (' ', 6)
+                      << juce::String (r.numInf).paddedLeft (' ', 6)
+                      << juce::String (r.numDenormal).paddedLeft (' ', 10)
+                      << (overLimit || r.hasBadOutput() ? "  FAIL" : "") << "\n";
+        }
+    }
+
+    if (settings.reportFile != juce::File() && ! settings.reportFile.replaceWithText (toJson (results, settings, passed)))
+    {
+        std::cerr << "Cannot write " << settings.reportFile.getFullPathName() << "\n";
+        return 1;
+    }
+
+    std::cout << (passed ? "passed" : "FAILED") << "\n";
+    return passed ? 0 : 1;
+}
\ No newline at end of file